@@ -31,24 +31,95 @@
 #define DBG_(_x)       ((void)0)
 #endif
 
-STATIC struct chip8_regs_struct chip8_regs;
+STATIC CHIP8_TLS struct chip8_regs_struct chip8_regs;
 
-static byte chip8_key_pressed;
-STATIC byte chip8_keys[16];                     /* if 1, key is held down   */
-STATIC byte chip8_display[CHIP8_WIDTH*CHIP8_HEIGHT]; /* 0xff if pixel is set,    */
+static CHIP8_TLS byte chip8_key_pressed;
+STATIC CHIP8_TLS word chip8_keys;               /* bit n set: key n is held */
+STATIC CHIP8_TLS byte chip8_display[CHIP8_WIDTH*CHIP8_HEIGHT]; /* 0xff if pixel is set,    */
                                                 /* 0x00 otherwise           */
 #ifdef CHIP8_SUPER
-STATIC byte chip8_super;	/* != 0 if in SCHIP display mode */
+STATIC CHIP8_TLS byte chip8_super;	/* != 0 if in SCHIP display mode */
 #endif
-STATIC byte chip8_mem[4096];                    /* machine memory. program  */
+STATIC CHIP8_TLS byte chip8_mem[4096];          /* machine memory. program  */
                                                 /* is loaded at 0x200       */
 
 #define read_mem(a)     (chip8_mem[(a)&4095])
-#define write_mem(a,v)  (chip8_mem[(a)&4095]=(v))
+#define write_mem(a,v)  (cow_touch_mem((a)&4095),hash_mem((a)&4095,v),\
+                         chip8_mem[(a)&4095]=(v))
 
-STATIC byte chip8_iperiod;
+static CHIP8_TLS byte run_events;               /* CHIP8_RUN_* events seen  */
+                                                /* since chip8_run started  */
+#define touch_display(from,to) (cow_touch_display(from,to),\
+                                run_events|=CHIP8_RUN_DISPLAY)
 
-STATIC byte chip8_running;                     /* Flag for End-of-Emulation */
+#ifdef CHIP8_COW
+static CHIP8_TLS struct chip8_page *cow_base[CHIP8_PAGES]; /* shared page each page  */
+                                                /* last matched             */
+static CHIP8_TLS unsigned long long cow_dirty=~0ULL;      /* pages written since      */
+#define cow_touch_mem(a) (cow_dirty|=1ULL<<((a)>>8))
+
+static void cow_touch_display(int from,int to)  /* display bytes from..to-1 */
+{
+    for (from/=CHIP8_PAGE;from*CHIP8_PAGE<to;++from)
+        cow_dirty|=1ULL<<(16+from);
+}
+#else
+#define cow_touch_mem(a) ((void)0)
+#define cow_touch_display(from,to) ((void)0)
+#endif
+
+#ifdef CHIP8_HASH
+#define HASH_PARTS ((sizeof(chip8_mem)+sizeof(chip8_display))>>8)
+static CHIP8_TLS unsigned long long hash_part[HASH_PARTS]; /* chip8_hash of each 256  */
+                                                /* bytes of memory, then    */
+                                                /* display                  */
+static unsigned long long hash_mix(unsigned long long x)
+{
+    x^=x>>30;
+    x*=0xbf58476d1ce4e5b9ULL;
+    x^=x>>27;
+    x*=0x94d049bb133111ebULL;
+    return x^(x>>31);
+}
+/* every non-zero memory byte and lit pixel adds its own random value, so  */
+/* a write swaps the old value's out for the new one's                      */
+#define hash_byte(a,v)  ((v)?hash_mix(((unsigned long long)(a)<<8)|(v)):0)
+#define hash_mem(a,v)   (hash_part[(a)>>8]^=hash_byte(a,chip8_mem[a])^hash_byte(a,(byte)(v)))
+#define hash_pixel(p)   (hash_part[16+((p)>>8)]^=hash_mix((1ULL<<20)+(p)))
+#define hash_clear_display() \
+    memset (hash_part+16,0,sizeof(hash_part)-16*sizeof(hash_part[0]))
+
+static int hash_zero8(const byte *p)            /* skip blank runs quickly  */
+{
+    unsigned long long w;
+    memcpy (&w,p,8);
+    return !w;
+}
+
+static void hash_redo_display(void)             /* after a scroll           */
+{
+    unsigned p;
+    hash_clear_display();
+    for (p=0;p<sizeof(chip8_display);++p)
+        if (!(p&7) && hash_zero8(chip8_display+p))
+            p+=7;
+        else if (chip8_display[p])
+            hash_pixel(p);
+}
+#else
+#define hash_mem(a,v)   ((void)0)
+#define hash_pixel(p)   ((void)0)
+#define hash_clear_display() ((void)0)
+#define hash_redo_display() ((void)0)
+#endif
+
+STATIC CHIP8_TLS byte chip8_iperiod;
+STATIC CHIP8_TLS byte chip8_quirks;
+
+STATIC CHIP8_TLS byte chip8_running;           /* Flag for End-of-Emulation */
+STATIC CHIP8_TLS byte chip8_run_mask;
+
+STATIC CHIP8_TLS unsigned long chip8_rng;
 
 #define get_reg_offset(opcode)          (chip8_regs.alg+(opcode>>8))
 #define get_reg_value(opcode)           (*get_reg_offset(opcode))
@@ -99,7 +170,7 @@ static void op_key (word opcode)
 	DBG_(printf("testing key %d\n", key));
     }
 #endif
-    key_value=chip8_keys[key];
+    key_value=(chip8_keys>>key)&1;
     if (cp_value==key_value)
         chip8_regs.pc+=2;
 }
@@ -145,12 +216,17 @@ static void op_mvi (word opcode)
 
 static void op_jmi (word opcode)
 {
-    chip8_regs.pc=opcode+chip8_regs.alg[0];
+    if (chip8_quirks&CHIP8_QUIRK_JUMP)
+        chip8_regs.pc=opcode+get_reg_value(opcode);
+    else
+        chip8_regs.pc=opcode+chip8_regs.alg[0];
 }
 
 static void op_rand (word opcode)
 {
-    *get_reg_offset(opcode)=rand()&(opcode&0xff);
+    /* own generator so the sequence is part of the saved state */
+    chip8_rng=chip8_rng*1103515245+12345;
+    *get_reg_offset(opcode)=(byte)(chip8_rng>>16)&(opcode&0xff);
 }
 
 static void math_or (byte *reg1,byte reg2)
@@ -198,14 +274,16 @@ static void math_sub (byte *reg1,byte reg2)
 
 static void math_shr (byte *reg1,byte reg2)
 {
-    (void)reg2;
+    if (chip8_quirks&CHIP8_QUIRK_SHIFT)
+        *reg1=reg2;
     chip8_regs.alg[15]=*reg1&1;
     *reg1>>=1;
 }
 
 static void math_shl (byte *reg1,byte reg2)
 {
-    (void)reg2;
+    if (chip8_quirks&CHIP8_QUIRK_SHIFT)
+        *reg1=reg2;
     chip8_regs.alg[15]=*reg1>>7;
     *reg1<<=1;
 }
@@ -225,6 +303,7 @@ static void scroll_down(word opcode)
     int n = opcode & 0xf;
     byte *dst = chip8_display + CHIP8_WIDTH*CHIP8_HEIGHT -1;
     byte *src = dst - n*CHIP8_WIDTH;
+    touch_display(0,sizeof(chip8_display));
     while(src >= chip8_display) {
 	*dst-- = *src--;
     }
@@ -239,6 +318,7 @@ static void scroll_left(void)
     byte *src = dst;
     byte *eol = chip8_display + CHIP8_WIDTH;
     byte *eoi = chip8_display + CHIP8_WIDTH*CHIP8_HEIGHT;
+    touch_display(0,sizeof(chip8_display));
     while(eol <= eoi) {
 	src+=4;
 	while(src < eol) {
@@ -257,6 +337,7 @@ static void scroll_right(void)
     byte *src = dst;
     byte *bol = chip8_display + CHIP8_WIDTH*(CHIP8_HEIGHT-1);
     DBG_(printf("SUPER: scroll 4 pixels right\n"));
+    touch_display(0,sizeof(chip8_display));
     while(bol >= chip8_display) {
 	src-=4;
 	while(src >= bol) {
@@ -278,9 +359,11 @@ static void op_system (word opcode)
 #ifdef CHIP8_SUPER
     case 0xfb:
 	scroll_right();
+	hash_redo_display();
 	break;
     case 0xfc:
 	scroll_left();
+	hash_redo_display();
 	break;	
     case 0xfd:
 	DBG_(printf("SUPER: quit the emulator\n"));
@@ -289,16 +372,22 @@ static void op_system (word opcode)
     case 0xfe:
 	DBG_(printf("SUPER: set CHIP-8 graphic mode\n"));
 	memset (chip8_display,0,sizeof(chip8_display));
+	touch_display(0,sizeof(chip8_display));
+	hash_clear_display();
 	chip8_super = 0;
 	break;
     case 0xff:
 	DBG_(printf("SUPER: set SCHIP graphic mode\n"));
 	memset (chip8_display,0,sizeof(chip8_display));
+	touch_display(0,sizeof(chip8_display));
+	hash_clear_display();
 	chip8_super = 1;
 	break;	
 #endif
         case 0xe0:
             memset (chip8_display,0,sizeof(chip8_display));
+            touch_display(0,sizeof(chip8_display));
+            hash_clear_display();
             break;
         case 0xee:
             chip8_regs.pc=read_mem(chip8_regs.sp)<<8;
@@ -309,12 +398,16 @@ static void op_system (word opcode)
     default:
 #ifdef CHIP8_SUPER
 	if ((opcode & 0xF0) == 0xC0)
+	{
 	    scroll_down(opcode);
+	    hash_redo_display();
+	}
 	else
 #endif
 	{
 	    DBG_(printf("unhandled system opcode 0x%x\n", opcode));
 	    chip8_running = 3;
+	    run_events|=CHIP8_RUN_HALT;
 	}
 	break;
     }
@@ -342,7 +435,10 @@ static void op_misc (word opcode)
 	    if (chip8_key_pressed)
                 *reg=chip8_key_pressed-1;
             else
+            {
                 chip8_regs.pc-=2;
+                run_events|=CHIP8_RUN_KEYWAIT;
+            }
             break;
         case 0x15:		/* sdelay */
             chip8_regs.delay=*reg;
@@ -350,7 +446,10 @@ static void op_misc (word opcode)
         case 0x18:		/* ssound */
             chip8_regs.sound=*reg;
             if (chip8_regs.sound)
+            {
                 chip8_sound_on();
+                run_events|=CHIP8_RUN_SOUND;
+            }
             break;
         case 0x1e:		/* adi */
             chip8_regs.i+=(*reg);
@@ -376,10 +475,14 @@ static void op_misc (word opcode)
         case 0x55:		/* str */
             for (i=0,j=(opcode>>8)&0x0f; i<=j; ++i)
                 write_mem(chip8_regs.i+i,chip8_regs.alg[i]);
+            if (chip8_quirks&CHIP8_QUIRK_LOADSTORE)
+                chip8_regs.i+=j+1;
             break;
         case 0x65:		/* ldr */
             for (i=0,j=(opcode>>8)&0x0f; i<=j; ++i)
                 chip8_regs.alg[i]=read_mem(chip8_regs.i+i);
+            if (chip8_quirks&CHIP8_QUIRK_LOADSTORE)
+                chip8_regs.i+=j+1;
             break;
 #ifdef CHIP8_SUPER
     case 0x75:
@@ -415,28 +518,30 @@ static void op_sprite (word opcode)
 	    n = 16;
 	    if (n+y>64)
 		n=64-y;
+	    touch_display(y*CHIP8_WIDTH,(y+n)*CHIP8_WIDTH);
 	    for (collision=1;n;--n,q+=CHIP8_WIDTH)
 	    {
 		/* first 8 bits */
 		for (y=read_mem(p++),x2=x;y;y<<=1,x2=(x2+1)&(CHIP8_WIDTH-1))
 		    if (y&0x80)
-			collision&=(q[x2]^=0xff);
+			collision&=(hash_pixel(q-chip8_display+x2),q[x2]^=0xff);
 		x2=(x+8)&(CHIP8_WIDTH-1);
 		/* last 8 bits */
 		for (y=read_mem(p++);y;y<<=1,x2=(x2+1)&(CHIP8_WIDTH-1))
 		    if (y&0x80)
-			collision&=(q[x2]^=0xff);
+			collision&=(hash_pixel(q-chip8_display+x2),q[x2]^=0xff);
 	    }
 	}
 	else {
 	    /* 8xn sprite */
 	    if (n+y>64)
 		n=64-y;
+	    touch_display(y*CHIP8_WIDTH,(y+n)*CHIP8_WIDTH);
 	    for (collision=1;n;--n,q+=CHIP8_WIDTH)
 	    {
 		for (y=read_mem(p++),x2=x;y;y<<=1,x2=(x2+1)&(CHIP8_WIDTH-1))
 		    if (y&0x80)
-			collision&=(q[x2]^=0xff);
+			collision&=(hash_pixel(q-chip8_display+x2),q[x2]^=0xff);
 	    }
 	}
     }
@@ -448,6 +553,7 @@ static void op_sprite (word opcode)
 	    n = 16;
 	if (n+y>32)
 	    n=32-y;
+	touch_display(y*CHIP8_WIDTH*2,(y+n)*CHIP8_WIDTH*2);
 	for (collision=1;n;--n,q+=CHIP8_WIDTH*2)
 	{
 	    for (y=read_mem(p++),x2=x*2;y;y<<=1,x2=(x2+2)&(CHIP8_WIDTH-1))
@@ -456,6 +562,10 @@ static void op_sprite (word opcode)
 		    q[x2+1]^=0xff;
 		    q[x2+CHIP8_WIDTH]^=0xff;
 		    q[x2+CHIP8_WIDTH+1]^=0xff;
+		    hash_pixel(q-chip8_display+x2);
+		    hash_pixel(q-chip8_display+x2+1);
+		    hash_pixel(q-chip8_display+x2+CHIP8_WIDTH);
+		    hash_pixel(q-chip8_display+x2+CHIP8_WIDTH+1);
 		    collision &= q[x2]|q[x2+1]|q[x2+CHIP8_WIDTH]|q[x2+CHIP8_WIDTH+1];
 		}
 	}
@@ -466,11 +576,12 @@ static void op_sprite (word opcode)
     q=chip8_display+y*CHIP8_WIDTH;
     if (n+y>32)
         n=32-y;
+    touch_display(y*CHIP8_WIDTH,(y+n)*CHIP8_WIDTH);
     for (collision=1;n;--n,q+=CHIP8_WIDTH)
     {
         for (y=read_mem(p++),x2=x;y;y<<=1,x2=(x2+1)&(CHIP8_WIDTH-1))
             if (y&0x80)
-		collision&=(q[x2]^=0xff);
+		collision&=(hash_pixel(q-chip8_display+x2),q[x2]^=0xff);
     }
 #endif
     chip8_regs.alg[15]=collision^1;
@@ -522,9 +633,241 @@ static opcode_fn main_opcodes[16]=
     op_misc
 };
 
+/****************************************************************************/
+/* Breakpoints and watchpoints. A breakpoint or watch that is set switches  */
+/* chip8_timeslice over to a checked loop once per timeslice; with watches */
+/* that loop runs the opcodes that touch memory through checking wrappers   */
+/* in watch_opcodes. With nothing set the core runs the plain loop          */
+/****************************************************************************/
+#define test_bit(map,a)     ((map)[((a)&4095)>>3]&(1<<((a)&7)))
+
+STATIC CHIP8_TLS byte chip8_stop_reason;
+STATIC CHIP8_TLS word chip8_stop_addr;
+
+static CHIP8_TLS byte break_map[4096/8];        /* any breakpoint at addr   */
+static CHIP8_TLS byte always_map[4096/8];       /* one without a condition  */
+static CHIP8_TLS byte watch_map[2][4096/8];     /* read, write watches      */
+static CHIP8_TLS struct
+{
+    word addr;
+    byte reg,op,value;
+} conditions[CHIP8_MAX_CONDITIONS];
+static CHIP8_TLS int num_conditions;
+static CHIP8_TLS int num_breaks,num_watches;
+static CHIP8_TLS byte single_step;
+static CHIP8_TLS byte armed;                    /* anything set             */
+static CHIP8_TLS byte slice_left;               /* opcodes left in a slice  */
+static CHIP8_TLS int run_left;                  /* chip8_run budget, or 0   */
+static CHIP8_TLS byte run_stop;                 /* chip8_run events that    */
+                                                /* end the run              */
+                                                /* cut short by a stop      */
+static CHIP8_TLS word resume_pc=0xffff;         /* breakpoint to step over  */
+
+static void watch_hit (byte reason,word addr,int len)
+{
+    int kind=reason==CHIP8_STOP_WRITE;
+    for (;len>0;--len,++addr)
+        if (test_bit(watch_map[kind],addr))
+        {
+            if (!chip8_stop_reason)
+            {
+                chip8_stop_reason=reason;
+                chip8_stop_addr=addr&4095;
+            }
+            return;
+        }
+}
+
+static void watch_system (word opcode)
+{
+    if ((byte)opcode==0xee)
+        watch_hit (CHIP8_STOP_READ,chip8_regs.sp,2);
+    op_system (opcode);
+}
+
+static void watch_call (word opcode)
+{
+    watch_hit (CHIP8_STOP_WRITE,chip8_regs.sp-2,2);
+    op_call (opcode);
+}
+
+/* bytes op_sprite reads: n rows, or 16 for n=0, cut off at the bottom */
+static int sprite_bytes (word opcode)
+{
+    int n=opcode&0x0f,y=get_reg_value_2(opcode),width=1,height=32;
+#ifdef CHIP8_SUPER
+    if (chip8_super)
+    {
+        height=64;
+        if (!n)
+            width=2;
+    }
+#endif
+    y&=height-1;
+    if (!n)
+        n=16;
+    if (n+y>height)
+        n=height-y;
+    return n*width;
+}
+
+static void watch_sprite (word opcode)
+{
+    watch_hit (CHIP8_STOP_READ,chip8_regs.i,sprite_bytes(opcode));
+    op_sprite (opcode);
+}
+
+static void watch_misc (word opcode)
+{
+    int len=((opcode>>8)&0x0f)+1;
+    switch ((byte)opcode)
+    {
+        case 0x33:
+            watch_hit (CHIP8_STOP_WRITE,chip8_regs.i,3);
+            break;
+        case 0x55:
+            watch_hit (CHIP8_STOP_WRITE,chip8_regs.i,len);
+            break;
+        case 0x65:
+            watch_hit (CHIP8_STOP_READ,chip8_regs.i,len);
+            break;
+    }
+    op_misc (opcode);
+}
+
+/* main_opcodes for the checked slice while any watch is set */
+static opcode_fn watch_opcodes[16]=
+{
+    watch_system,
+    op_jmp,
+    watch_call,
+    op_skeq_const,
+    op_skne_const,
+    op_skeq_reg,
+    op_mov_const,
+    op_add_const,
+    op_math,
+    op_skne_reg,
+    op_mvi,
+    op_jmi,
+    op_rand,
+    watch_sprite,
+    op_key,
+    watch_misc
+};
+
+static void update_armed (void)
+{
+    armed=num_breaks>0||num_watches>0||single_step;
+}
+
+static int count_bits (const byte *map)
+{
+    int i,n=0;
+    for (i=0;i<4096/8;++i)
+        n+=map[i]!=0;
+    return n;
+}
+
+STATIC void chip8_set_breakpoint (word addr,byte set)
+{
+    int i,k;
+    addr&=4095;
+    if (set)
+    {
+        break_map[addr>>3]|=1<<(addr&7);
+        always_map[addr>>3]|=1<<(addr&7);
+    }
+    else
+    {
+        break_map[addr>>3]&=~(1<<(addr&7));
+        always_map[addr>>3]&=~(1<<(addr&7));
+        for (i=k=0;i<num_conditions;++i)
+            if (conditions[i].addr!=addr)
+                conditions[k++]=conditions[i];
+        num_conditions=k;
+    }
+    num_breaks=count_bits(break_map);
+    update_armed ();
+}
+
+STATIC int chip8_set_condition (word addr,byte reg,byte op,byte value)
+{
+    if (num_conditions==CHIP8_MAX_CONDITIONS || op>CHIP8_COND_GE)
+        return 0;
+    addr&=4095;
+    conditions[num_conditions].addr=addr;
+    conditions[num_conditions].reg=reg&0x0f;
+    conditions[num_conditions].op=op;
+    conditions[num_conditions].value=value;
+    num_conditions++;
+    break_map[addr>>3]|=1<<(addr&7);
+    num_breaks=count_bits(break_map);
+    update_armed ();
+    return 1;
+}
+
+STATIC void chip8_set_watchpoint (word addr,word len,byte flags)
+{
+    for (;len;--len,++addr)
+    {
+        word a=addr&4095;
+        if (flags&CHIP8_WATCH_READ)
+            watch_map[0][a>>3]|=1<<(a&7);
+        else
+            watch_map[0][a>>3]&=~(1<<(a&7));
+        if (flags&CHIP8_WATCH_WRITE)
+            watch_map[1][a>>3]|=1<<(a&7);
+        else
+            watch_map[1][a>>3]&=~(1<<(a&7));
+    }
+    num_watches=count_bits(watch_map[0])+count_bits(watch_map[1]);
+    update_armed ();
+}
+
+STATIC void chip8_set_step (byte on)
+{
+    single_step=on;
+    update_armed ();
+}
+
+STATIC void chip8_clear_debug (void)
+{
+    memset (break_map,0,sizeof(break_map));
+    memset (always_map,0,sizeof(always_map));
+    memset (watch_map,0,sizeof(watch_map));
+    num_conditions=num_breaks=num_watches=0;
+    single_step=0;
+    update_armed ();
+}
+
+/* does the breakpoint at pc fire with the current registers */
+static int break_taken (word pc)
+{
+    int i;
+    if (test_bit(always_map,pc))
+        return 1;
+    for (i=0;i<num_conditions;++i)
+    {
+        byte v,c;
+        if (conditions[i].addr!=pc)
+            continue;
+        v=chip8_regs.alg[conditions[i].reg];
+        c=conditions[i].value;
+        switch (conditions[i].op)
+        {
+            case CHIP8_COND_EQ: if (v==c) return 1; break;
+            case CHIP8_COND_NE: if (v!=c) return 1; break;
+            case CHIP8_COND_LT: if (v<c) return 1; break;
+            case CHIP8_COND_GE: if (v>=c) return 1; break;
+        }
+    }
+    return 0;
+}
+
 #ifdef CHIP8_DEBUG
-STATIC byte chip8_trace;
-STATIC word chip8_trap;
+STATIC CHIP8_TLS byte chip8_trace;
+STATIC CHIP8_TLS word chip8_trap;
 
 /****************************************************************************/
 /* This routine is called every opcode when chip8_trace==1. It prints the   */
@@ -702,40 +1045,107 @@ STATIC void chip8_debug (word opcode,struct chip8_regs_struct *regs)
 #endif
 
 /****************************************************************************/
-/* Execute chip8_iperiod opcodes                                            */
+/* Execute opcodes with breakpoint and watch checks. Returns 0 if stopped   */
+/* before the end of the timeslice, which then continues on the next call   */
 /****************************************************************************/
-STATIC void chip8_execute(void)
+static int chip8_checked_slice(void)
 {
-    byte i;
-    byte key_pressed=0;
-    word opcode;
-    for (i = chip8_iperiod ; i ;--i)
+    word opcode,pc;
+    opcode_fn *opcodes=num_watches ? watch_opcodes : main_opcodes;
+    if (!slice_left)
+        slice_left=chip8_iperiod;
+    for (;slice_left;--slice_left)
     {
-	/* Fetch the opcode */
+        pc=chip8_regs.pc&4095;
+        if (pc!=resume_pc && test_bit(break_map,pc) && break_taken(pc))
+        {
+            chip8_stop_reason=CHIP8_STOP_BREAK;
+            chip8_stop_addr=pc;
+            resume_pc=pc;
+            chip8_running=2;
+            return 0;
+        }
+        resume_pc=0xffff;
         opcode=(read_mem(chip8_regs.pc)<<8)+read_mem(chip8_regs.pc+1);
 #ifdef CHIP8_DEBUG
 	/* Check if trap address has been reached */
-	if ((chip8_regs.pc&4095)==chip8_trap)
+	if (pc==chip8_trap)
 	    chip8_trace=1;
 	/* Call the debugger if chip8_trace!=0 */
 	if (chip8_trace)
 	    chip8_debug (opcode,&chip8_regs);
 #endif
         chip8_regs.pc+=2;
-        (*(main_opcodes[opcode>>12]))(opcode&0x0fff); /* Emulate this opcode */
+        (*(opcodes[opcode>>12]))(opcode&0x0fff); /* Emulate this opcode */
+        if (single_step && !chip8_stop_reason)
+        {
+            chip8_stop_reason=CHIP8_STOP_STEP;
+            chip8_stop_addr=chip8_regs.pc&4095;
+        }
+        if (chip8_stop_reason)                  /* a watch fired or step    */
+            chip8_running=2;
+        if (chip8_stop_reason || (run_left && !--run_left) || (run_events&run_stop))
+        {
+            if (--slice_left)
+                return 0;
+            break;
+        }
     }
-    /* Update timers */
+    return 1;
+}
+
+/****************************************************************************/
+/* Update the timers at the end of a timeslice                              */
+/****************************************************************************/
+static void chip8_timers(void)
+{
     if (chip8_regs.delay)
         --chip8_regs.delay;
     if (chip8_regs.sound)
         if (--chip8_regs.sound == 0)
-            chip8_sound_off();       
+        {
+            chip8_sound_off();
+            run_events|=CHIP8_RUN_SOUND;
+        }
+}
 
-    /* Update the machine status */
-    chip8_interrupt ();
+/****************************************************************************/
+/* Execute chip8_iperiod opcodes and update the timers                      */
+/****************************************************************************/
+static void chip8_timeslice(void)
+{
+#ifndef CHIP8_DEBUG
+    if (!armed)
+    {
+        byte i;
+        word opcode;
+        /* finish a slice a stop cut short, then whole ones */
+        for (i = slice_left ? slice_left : chip8_iperiod ; i ;--i)
+        {
+            /* Fetch the opcode */
+            opcode=(read_mem(chip8_regs.pc)<<8)+read_mem(chip8_regs.pc+1);
+            chip8_regs.pc+=2;
+            (*(main_opcodes[opcode>>12]))(opcode&0x0fff); /* Emulate this opcode */
+        }
+        slice_left=0;
+        resume_pc=0xffff;
+    }
+    else
+#endif
+    if (!chip8_checked_slice ())
+        return;
+    chip8_timers ();
+}
 
+/****************************************************************************/
+/* Derive the first-pressed key from chip8_keys                             */
+/****************************************************************************/
+static void chip8_update_key_pressed(void)
+{
+    byte i;
+    byte key_pressed=0;
     for (i=key_pressed=0;i<16;++i)              /* check if a key was first */
-        if (chip8_keys[i])	                /* pressed                  */
+        if (chip8_keys&(1<<i))                  /* pressed                  */
             key_pressed=i+1;
     if (key_pressed && key_pressed!=chip8_key_pressed)
         chip8_key_pressed=key_pressed;
@@ -743,6 +1153,300 @@ STATIC void chip8_execute(void)
         chip8_key_pressed=0;
 }
 
+/****************************************************************************/
+/* Press or release a key between two opcodes. Inside a timeslice a press   */
+/* becomes chip8_key_pressed at once, so Fx0A sees it even if the key is    */
+/* up again before the slice ends; before the slice starts it is left to    */
+/* chip8_update_key_pressed as for keys set by the host                     */
+/****************************************************************************/
+STATIC void chip8_key(int key, int down)
+{
+    key&=15;
+    if (down)
+        chip8_keys|=1<<key;
+    else
+        chip8_keys&=~(1<<key);
+    if (!slice_left)
+        return;
+    if (down)
+        chip8_key_pressed=key+1;
+    else if (chip8_key_pressed==key+1)
+        chip8_key_pressed=0;
+}
+
+/****************************************************************************/
+/* Execute chip8_iperiod opcodes                                            */
+/****************************************************************************/
+STATIC void chip8_execute(void)
+{
+    chip8_stop_reason=0;
+    chip8_timeslice ();
+    if (slice_left)                             /* stopped inside the slice */
+        return;
+
+    /* Update the machine status */
+    chip8_interrupt ();
+
+    chip8_update_key_pressed ();
+}
+
+/****************************************************************************/
+/* Execute one timeslice for a host that sets chip8_keys itself. Running    */
+/* frames this way gives the same result as chip8_execute with the keys     */
+/* set by chip8_interrupt                                                   */
+/****************************************************************************/
+STATIC void chip8_frame(void)
+{
+    chip8_stop_reason=0;
+    if (!slice_left)
+        chip8_update_key_pressed ();
+    chip8_timeslice ();
+}
+
+/****************************************************************************/
+/* Execute the current timeslice like chip8_frame, but return as soon as    */
+/* budget opcodes (if >0) ran or one of the events in chip8_run_mask        */
+/* happened. Returns the CHIP8_RUN_* reasons; the next call continues       */
+/* where this one stopped                                                   */
+/****************************************************************************/
+STATIC int chip8_run(int budget)
+{
+    byte before;
+    int reasons;
+    if (chip8_running!=1)
+        return chip8_running==2 ? CHIP8_RUN_BREAK : CHIP8_RUN_HALT;
+    chip8_stop_reason=0;
+    run_events=0;
+    run_stop=chip8_run_mask|CHIP8_RUN_HALT;
+    if (!slice_left)
+    {
+        chip8_update_key_pressed ();
+        slice_left=chip8_iperiod;
+    }
+    before=slice_left;
+#ifndef CHIP8_DEBUG
+    if (!armed)
+    {
+        word opcode;
+        int left=budget;
+        while (slice_left)
+        {
+            opcode=(read_mem(chip8_regs.pc)<<8)+read_mem(chip8_regs.pc+1);
+            chip8_regs.pc+=2;
+            (*(main_opcodes[opcode>>12]))(opcode&0x0fff); /* Emulate this opcode */
+            --slice_left;
+            if (!--left || (run_events&run_stop))
+                break;
+        }
+        if (!slice_left)
+            resume_pc=0xffff;
+    }
+    else
+#endif
+    {
+        run_left=budget>0 ? budget : 0;
+        chip8_checked_slice ();
+        run_left=0;
+    }
+    run_stop=0;
+    if (!slice_left)
+        chip8_timers ();
+    reasons=run_events&(chip8_run_mask|CHIP8_RUN_HALT);
+    if (!slice_left)
+        reasons|=CHIP8_RUN_FRAME;
+    else if (budget>0 && before-slice_left>=budget)
+        reasons|=CHIP8_RUN_BUDGET;
+    if (chip8_running==2)
+        reasons|=CHIP8_RUN_BREAK;
+    return reasons;
+}
+
+/****************************************************************************/
+/* Save and restore the complete machine state                              */
+/****************************************************************************/
+STATIC void chip8_save_state(struct chip8_state *state)
+{
+    state->regs=chip8_regs;
+    state->rng=chip8_rng;
+    state->keys=chip8_keys;
+    state->key_pressed=chip8_key_pressed;
+#ifdef CHIP8_SUPER
+    state->super=chip8_super;
+#else
+    state->super=0;
+#endif
+    state->running=chip8_running;
+    memcpy (state->mem,chip8_mem,sizeof(chip8_mem));
+    memcpy (state->display,chip8_display,sizeof(chip8_display));
+}
+
+STATIC void chip8_load_state(const struct chip8_state *state)
+{
+    chip8_regs=state->regs;
+    chip8_rng=state->rng;
+    chip8_keys=state->keys;
+    chip8_key_pressed=state->key_pressed;
+#ifdef CHIP8_SUPER
+    chip8_super=state->super;
+#endif
+    chip8_running=state->running;
+    slice_left=0;
+    resume_pc=0xffff;
+    memcpy (chip8_mem,state->mem,sizeof(chip8_mem));
+    memcpy (chip8_display,state->display,sizeof(chip8_display));
+#ifdef CHIP8_COW
+    cow_dirty=~0ULL;
+#endif
+#ifdef CHIP8_HASH
+    chip8_rehash ();
+#endif
+}
+
+#ifdef CHIP8_HASH
+/****************************************************************************/
+/* Machine state hash. Memory and display are hashed as they change; the    */
+/* registers and the rest are few enough to fold in on every call           */
+/****************************************************************************/
+STATIC void chip8_rehash(void)
+{
+    int a;
+    memset (hash_part,0,sizeof(hash_part));
+    for (a=0;a<4096;++a)
+        if (!(a&7) && hash_zero8(chip8_mem+a))
+            a+=7;
+        else
+            hash_part[a>>8]^=hash_byte(a,chip8_mem[a]);
+    hash_redo_display();
+}
+
+STATIC unsigned long long chip8_hash(void)
+{
+    unsigned long long h=0,w[2];
+    unsigned i;
+    for (i=0;i<HASH_PARTS;++i)
+        h^=hash_part[i];
+    h=hash_mix(h);
+    memcpy (w,chip8_regs.alg,sizeof(w));
+    h=hash_mix(h^w[0]);
+    h=hash_mix(h^w[1]);
+    h=hash_mix(h^((unsigned long long)chip8_regs.i<<48|(unsigned long long)chip8_regs.pc<<32|
+                   (unsigned long long)chip8_regs.sp<<16|chip8_regs.delay<<8|chip8_regs.sound));
+    h=hash_mix(h^chip8_rng);
+#ifdef CHIP8_SUPER
+    h=hash_mix(h^(chip8_keys|chip8_key_pressed<<16|chip8_running<<24|
+                  (unsigned long long)chip8_super<<32));
+#else
+    h=hash_mix(h^(chip8_keys|chip8_key_pressed<<16|chip8_running<<24));
+#endif
+    return h;
+}
+#endif
+
+#ifdef CHIP8_COW
+/****************************************************************************/
+/* Copy-on-write forks. The running machine keeps its own chip8_mem and     */
+/* chip8_display; cow_base holds the shared page each of their pages last   */
+/* matched and cow_dirty the pages written since, so a fork copies only     */
+/* those and shares the rest with its parent                                */
+/****************************************************************************/
+static byte *cow_live(int page)
+{
+    return page<16 ? chip8_mem+page*CHIP8_PAGE : chip8_display+(page-16)*CHIP8_PAGE;
+}
+
+static void cow_release(struct chip8_page *page)
+{
+    if (page && !--page->refs)
+        free (page);
+}
+
+STATIC struct chip8_fork *chip8_fork(void)
+{
+    struct chip8_fork *fork;
+    struct chip8_page *page;
+    int i;
+    if (!(fork=malloc(sizeof(*fork))))
+        return NULL;
+    for (i=0;i<CHIP8_PAGES;++i)
+    {
+        if ((cow_dirty>>i)&1)
+        {
+            /* written pages may still hold what they held before */
+            if (!cow_base[i] || memcmp(cow_base[i]->data,cow_live(i),CHIP8_PAGE))
+            {
+                if (!(page=malloc(sizeof(*page))))
+                {
+                    while (i--)
+                        cow_release (fork->page[i]);
+                    free (fork);
+                    return NULL;
+                }
+                memcpy (page->data,cow_live(i),CHIP8_PAGE);
+                page->refs=1;
+#ifdef CHIP8_HASH
+                page->hash=hash_part[i];
+#endif
+                cow_release (cow_base[i]);
+                cow_base[i]=page;
+            }
+            cow_dirty&=~(1ULL<<i);
+        }
+        fork->page[i]=cow_base[i];
+        cow_base[i]->refs++;
+    }
+    fork->regs=chip8_regs;
+    fork->rng=chip8_rng;
+    fork->keys=chip8_keys;
+    fork->key_pressed=chip8_key_pressed;
+#ifdef CHIP8_SUPER
+    fork->super=chip8_super;
+#else
+    fork->super=0;
+#endif
+    fork->running=chip8_running;
+    return fork;
+}
+
+STATIC void chip8_resume_fork(const struct chip8_fork *fork)
+{
+    int i;
+    for (i=0;i<CHIP8_PAGES;++i)
+    {
+        if (((cow_dirty>>i)&1) || cow_base[i]!=fork->page[i])
+        {
+            memcpy (cow_live(i),fork->page[i]->data,CHIP8_PAGE);
+#ifdef CHIP8_HASH
+            hash_part[i]=fork->page[i]->hash;
+#endif
+        }
+        fork->page[i]->refs++;
+        cow_release (cow_base[i]);
+        cow_base[i]=fork->page[i];
+    }
+    cow_dirty=0;
+    chip8_regs=fork->regs;
+    chip8_rng=fork->rng;
+    chip8_keys=fork->keys;
+    chip8_key_pressed=fork->key_pressed;
+#ifdef CHIP8_SUPER
+    chip8_super=fork->super;
+#endif
+    chip8_running=fork->running;
+    slice_left=0;
+    resume_pc=0xffff;
+}
+
+STATIC void chip8_free_fork(struct chip8_fork *fork)
+{
+    int i;
+    if (!fork)
+        return;
+    for (i=0;i<CHIP8_PAGES;++i)
+        cow_release (fork->page[i]);
+    free (fork);
+}
+#endif
+
 /****************************************************************************/
 /* Reset the virtual chip8 machine                                          */
 /****************************************************************************/
@@ -786,14 +1490,24 @@ STATIC void chip8_reset(void)
     chip8_super = 0;
 #endif
     memset (chip8_regs.alg,0,sizeof(chip8_regs.alg));
-    memset (chip8_keys,0,sizeof(chip8_keys));
+    chip8_keys=0;
     chip8_key_pressed=0;
     memset (chip8_display,0,sizeof(chip8_display));
     chip8_regs.delay=chip8_regs.sound=chip8_regs.i=0;
     chip8_regs.sp=0x1e0;
     chip8_regs.pc=0x200;
+    chip8_rng=rand();
     chip8_sound_off ();
     chip8_running=1;
+    chip8_stop_reason=0;
+    slice_left=0;
+    resume_pc=0xffff;
+#ifdef CHIP8_COW
+    cow_dirty=~0ULL;
+#endif
+#ifdef CHIP8_HASH
+    chip8_rehash ();
+#endif
 #ifdef CHIP8_DEBUG
     chip8_trace=0;
 #endif
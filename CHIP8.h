@@ -15,6 +15,12 @@
 #ifndef EXTERN
 #define EXTERN extern
 #endif
+
+#ifdef CHIP8_THREADS
+#define CHIP8_TLS __thread                      /* every thread runs its    */
+#else                                           /* own machine              */
+#define CHIP8_TLS
+#endif
  
 typedef unsigned char byte;                     /* sizeof(byte)==1          */
 typedef unsigned short word;                    /* sizeof(word)>=2          */
@@ -28,30 +34,157 @@ struct chip8_regs_struct
  word sp;                                       /* stack pointer            */
 };
 
-EXTERN struct chip8_regs_struct chip8_regs;
+EXTERN CHIP8_TLS struct chip8_regs_struct chip8_regs;
 
 #ifdef CHIP8_SUPER
 #define CHIP8_WIDTH 128
 #define CHIP8_HEIGHT 64
-EXTERN byte chip8_super;	/* != 0 if in SCHIP display mode */
+EXTERN CHIP8_TLS byte chip8_super;	/* != 0 if in SCHIP display mode */
 #else
 #define CHIP8_WIDTH 64
 #define CHIP8_HEIGHT 32
 #endif
 
-EXTERN byte chip8_iperiod;                      /* number of opcodes per    */
+#define CHIP8_QUIRK_SHIFT     0x01              /* 8xy6/8xyE shift VY, not  */
+                                                /* VX                       */
+#define CHIP8_QUIRK_LOADSTORE 0x02              /* Fx55/Fx65 advance I      */
+#define CHIP8_QUIRK_JUMP      0x04              /* Bxnn jumps to xnn+VX     */
+
+EXTERN CHIP8_TLS byte chip8_quirks;             /* CHIP8_QUIRK_* flags      */
+EXTERN CHIP8_TLS byte chip8_iperiod;            /* number of opcodes per    */
                                                 /* timeslice (1/50sec.)     */
-EXTERN byte chip8_keys[16];                     /* if 1, key is held down   */
-EXTERN byte chip8_display[CHIP8_WIDTH*CHIP8_HEIGHT];/* 0xff if pixel is set,    */
+EXTERN CHIP8_TLS word chip8_keys;               /* bit n set: key n is held */
+EXTERN CHIP8_TLS byte chip8_display[CHIP8_WIDTH*CHIP8_HEIGHT];/* 0xff if pixel is set,    */
                                                 /* 0x00 otherwise           */
-EXTERN byte chip8_mem[4096];                    /* machine memory. program  */
+EXTERN CHIP8_TLS byte chip8_mem[4096];          /* machine memory. program  */
                                                 /* is loaded at 0x200       */
-EXTERN byte chip8_running;                      /* if 0, emulation stops    */
+EXTERN CHIP8_TLS byte chip8_running;            /* if 0, emulation stops    */
+                                                /* 2: stopped by debugger,  */
+                                                /* set to 1 to continue     */
+EXTERN CHIP8_TLS unsigned long chip8_rng;       /* random number generator  */
+                                                /* state, seeded by reset   */
+
+struct chip8_state                              /* complete machine state,  */
+{                                               /* see chip8_save_state     */
+ struct chip8_regs_struct regs;
+ unsigned long rng;
+ word keys;
+ byte key_pressed;
+ byte super;
+ byte running;
+ byte mem[4096];
+ byte display[CHIP8_WIDTH*CHIP8_HEIGHT];
+};
 
 EXTERN void chip8_execute (void);                      /* execute chip8_iperiod    */
                                                 /* opcodes                  */
 EXTERN void chip8_reset (void);                        /* reset virtual machine    */
 EXTERN void chip8 (void);                              /* start chip8 emulation    */
+EXTERN void chip8_frame (void);                        /* execute one timeslice    */
+                                                /* with the current keys,   */
+                                                /* without calling          */
+                                                /* chip8_interrupt          */
+
+#define CHIP8_RUN_FRAME       0x01              /* chip8_run reasons: the   */
+                                                /* timeslice ended          */
+#define CHIP8_RUN_BUDGET      0x02              /* budget opcodes ran       */
+#define CHIP8_RUN_BREAK       0x04              /* debugger stop, see       */
+                                                /* chip8_stop_reason        */
+#define CHIP8_RUN_KEYWAIT     0x08              /* Fx0A waits for a key     */
+#define CHIP8_RUN_SOUND       0x10              /* sound went on or off     */
+#define CHIP8_RUN_DISPLAY     0x20              /* display was drawn to     */
+#define CHIP8_RUN_HALT        0x40              /* chip8_running left 1     */
+
+EXTERN CHIP8_TLS byte chip8_run_mask;           /* KEYWAIT, SOUND and       */
+                                                /* DISPLAY events that end  */
+                                                /* chip8_run early          */
+EXTERN int chip8_run (int budget);              /* run the timeslice until  */
+                                                /* it ends, budget opcodes  */
+                                                /* (if >0) ran or an event  */
+                                                /* in chip8_run_mask; does  */
+                                                /* not call chip8_interrupt */
+                                                /* and returns CHIP8_RUN_*  */
+EXTERN void chip8_key (int key, int down);      /* press or release key     */
+                                                /* between two opcodes,     */
+                                                /* e.g. after chip8_run     */
+                                                /* stopped on its budget    */
+EXTERN void chip8_save_state (struct chip8_state *state); /* snapshot machine  */
+EXTERN void chip8_load_state (const struct chip8_state *state); /* restore     */
+
+#ifdef CHIP8_HASH
+EXTERN unsigned long long chip8_hash (void);    /* 64 bit hash of the whole */
+                                                /* machine state, kept up   */
+                                                /* to date as it runs       */
+EXTERN void chip8_rehash (void);                /* call after writing       */
+                                                /* chip8_mem or display     */
+                                                /* from outside the core    */
+#endif
+
+#ifdef CHIP8_COW
+#define CHIP8_PAGE  256
+#define CHIP8_PAGES ((4096+CHIP8_WIDTH*CHIP8_HEIGHT)/CHIP8_PAGE)
+
+struct chip8_page                               /* 256 bytes of memory or   */
+{                                               /* display, shared by forks */
+ unsigned refs;
+#ifdef CHIP8_HASH
+ unsigned long long hash;                       /* its part of chip8_hash   */
+#endif
+ byte data[CHIP8_PAGE];
+};
+
+struct chip8_fork                               /* machine state sharing    */
+{                                               /* unchanged pages, see     */
+ struct chip8_regs_struct regs;                 /* chip8_fork               */
+ unsigned long rng;
+ word keys;
+ byte key_pressed;
+ byte super;
+ byte running;
+ struct chip8_page *page[CHIP8_PAGES];          /* memory, then display     */
+};
+
+EXTERN struct chip8_fork *chip8_fork (void);    /* snapshot machine; only   */
+                                                /* pages written since the  */
+                                                /* last fork or resume are  */
+                                                /* copied. NULL if out of   */
+                                                /* memory. Host writes to   */
+                                                /* chip8_mem/display must   */
+                                                /* come before the first    */
+                                                /* fork after a reset       */
+EXTERN void chip8_resume_fork (const struct chip8_fork *fork); /* restore, */
+                                                /* copying only the pages   */
+                                                /* that differ              */
+EXTERN void chip8_free_fork (struct chip8_fork *fork);
+#endif
+
+#define CHIP8_MAX_CONDITIONS 16
+#define CHIP8_COND_EQ         0                 /* conditional breakpoints  */
+#define CHIP8_COND_NE         1                 /* compare VX with a value  */
+#define CHIP8_COND_LT         2
+#define CHIP8_COND_GE         3
+#define CHIP8_WATCH_READ      0x01
+#define CHIP8_WATCH_WRITE     0x02
+#define CHIP8_STOP_BREAK      1                 /* chip8_stop_reason values */
+#define CHIP8_STOP_READ       2
+#define CHIP8_STOP_WRITE      3
+#define CHIP8_STOP_STEP       4
+
+EXTERN CHIP8_TLS byte chip8_stop_reason;        /* why chip8_running was    */
+                                                /* set to 2, or 0           */
+EXTERN CHIP8_TLS word chip8_stop_addr;          /* breakpoint or watched    */
+                                                /* address that stopped it  */
+EXTERN void chip8_set_breakpoint (word addr,byte set); /* set/clear at addr */
+EXTERN int chip8_set_condition (word addr,byte reg,byte op,byte value);
+                                                /* break at addr only when  */
+                                                /* V[reg] op value; 0 if    */
+                                                /* the table is full        */
+EXTERN void chip8_set_watchpoint (word addr,word len,byte flags);
+                                                /* CHIP8_WATCH_* or 0 to    */
+                                                /* clear                    */
+EXTERN void chip8_set_step (byte on);                  /* if 1, stop after every   */
+                                                /* opcode                   */
+EXTERN void chip8_clear_debug (void);                  /* remove all of the above  */
 
 EXTERN void chip8_sound_on (void);                     /* turn sound on            */
 EXTERN void chip8_sound_off (void);                    /* turn sound off           */
@@ -59,9 +192,9 @@ EXTERN void chip8_interrupt (void);                    /* update keyboard,
                                                 /* display, etc.            */
 
 #ifdef CHIP8_DEBUG
-EXTERN byte chip8_trace;                        /* if 1, call debugger      */
+EXTERN CHIP8_TLS byte chip8_trace;              /* if 1, call debugger      */
                                                 /* every opcode             */
-EXTERN word chip8_trap;                         /* if pc==trap, set trace   */
+EXTERN CHIP8_TLS word chip8_trap;               /* if pc==trap, set trace   */
                                                 /* flag                     */
 EXTERN void chip8_debug (word opcode,struct chip8_regs_struct *regs);
 #endif
@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+struct ArenaChunk
+{
+	ArenaChunk *next;
+	size_t used;
+	char data[];
+};
+
+#define ALIGN(n) (((n) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+
+void arenaInit(Arena *arena, size_t chunkSize)
+{
+	arena->head = arena->cur = NULL;
+	arena->chunkSize = chunkSize;
+	arena->fixed = 0;
+}
+
+void arenaInitFixed(Arena *arena, void *buffer, size_t size)
+{
+	ArenaChunk *c = (ArenaChunk*) buffer;
+	c->next = NULL;
+	c->used = 0;
+	arena->head = arena->cur = c;
+	arena->chunkSize = size - sizeof(ArenaChunk);
+	arena->fixed = 1;
+}
+
+void* arenaAlloc(Arena *arena, size_t size)
+{
+	ArenaChunk *c = arena->cur;
+	void *p;
+
+	size = ALIGN(size);
+	if (size > arena->chunkSize) return NULL;
+
+	if (!c || c->used + size > arena->chunkSize)
+	{
+		/* move on to the next chunk, reusing one left over from a reset */
+		if (c && c->next)
+			c = c->next;
+		else if (arena->fixed)
+			return NULL;
+		else
+		{
+			ArenaChunk *n = (ArenaChunk*) malloc(sizeof(ArenaChunk) + arena->chunkSize);
+			if (!n) return NULL;
+			n->next = NULL;
+			if (c) c->next = n;
+			else arena->head = n;
+			c = n;
+		}
+		c->used = 0;
+		arena->cur = c;
+	}
+	p = c->data + c->used;
+	c->used += size;
+	return p;
+}
+
+char* arenaStrdup(Arena *arena, const char *s)
+{
+	size_t n = strlen(s) + 1;
+	char *p = (char*) arenaAlloc(arena, n);
+	if (p) memcpy(p, s, n);
+	return p;
+}
+
+void arenaReset(Arena *arena)
+{
+	if (arena->head) arena->head->used = 0;
+	arena->cur = arena->head;
+}
+
+void arenaFree(Arena *arena)
+{
+	ArenaChunk *c = arena->head;
+	if (arena->fixed)
+	{
+		arenaReset(arena);
+		return;
+	}
+	while (c)
+	{
+		ArenaChunk *n = c->next;
+		free(c);
+		c = n;
+	}
+	arena->head = arena->cur = NULL;
+}
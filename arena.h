@@ -0,0 +1,42 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaChunk ArenaChunk;
+
+/* bump allocator that hands out memory from a list of fixed size chunks;
+   everything is released at once by arenaReset or arenaFree */
+typedef struct
+{
+	ArenaChunk *head;
+	ArenaChunk *cur;
+	size_t chunkSize;
+	int fixed;          // the only chunk is a buffer given to arenaInitFixed
+} Arena;
+
+extern void arenaInit(Arena *arena, size_t chunkSize);
+
+/**
+ * Use size bytes at buffer, aligned to a pointer, as the one and only
+ * chunk, so the arena never touches the heap; allocations fail once it
+ * is full and arenaFree only resets it.
+ */
+extern void arenaInitFixed(Arena *arena, void *buffer, size_t size);
+
+/**
+ * @return size bytes aligned to a pointer, or NULL if out of memory
+ * or size is bigger than a chunk
+ */
+extern void* arenaAlloc(Arena *arena, size_t size);
+
+extern char* arenaStrdup(Arena *arena, const char *s);
+
+/**
+ * Forget every allocation but keep the chunks around for reuse.
+ */
+extern void arenaReset(Arena *arena);
+
+extern void arenaFree(Arena *arena);
+
+#endif
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+#include "thread.h"
+
+typedef struct
+{
+	u8 data[CAPTURE_BUFFER];
+	int used;
+} Buffer;
+
+static Buffer buffers[2];
+static Buffer *current;
+static Sema filled, spare;       // buffers waiting for / done with the writer
+static Buffer *queued;
+static Thread writer;
+static FILE *file = NULL;
+static int format, width, height, elide, frameBytes, headerBytes;
+static u8 *last;                 // pixels of the frame kept last, as stored
+static int failed;               // a write or the close of the file failed
+static CaptureStats stats;
+
+static int writerThread(void *arg)
+{
+	(void)arg;
+	while (1)
+	{
+		semaWait(&filled);
+		Buffer *b = queued;
+		if (!b) return 0;       // captureClose
+		/* frames cut short by a write error are lost, whole or not */
+		size_t done = fwrite(b->data, 1, b->used, file);
+		if (done < (size_t)b->used)
+		{
+			stats.lost += b->used / frameBytes - done / frameBytes;
+			failed = 1;
+		}
+		b->used = 0;
+		semaSignal(&spare);
+	}
+}
+
+/* hand the current buffer to the writer and continue in the other one */
+static void swapBuffers(void)
+{
+	if (!semaTryWait(&spare))
+	{
+		stats.stalls++;
+		semaWait(&spare);
+	}
+	queued = current;
+	semaSignal(&filled);
+	current = current == &buffers[0] ? &buffers[1] : &buffers[0];
+}
+
+int captureOpen(const char *szPath, int fmt, int w, int h, int fps, int elideDuplicates)
+{
+	int ok;
+
+	if (file || (w * h) % 8) return 0;
+	headerBytes = fmt == CAPTURE_RAW ? 4 : 6;
+	frameBytes = headerBytes + (fmt == CAPTURE_RAW ? w * h / 8 : w * h);
+	if (!(last = (u8*) malloc(frameBytes - headerBytes))) return 0;
+	if (!(file = fopen(szPath, "wb")))
+	{
+		free(last);
+		return 0;
+	}
+
+	/* writes go out a buffer at a time already; unbuffered, what fwrite
+	   reports is what reached the file */
+	setvbuf(file, NULL, _IONBF, 0);
+	format = fmt;
+	width = w;
+	height = h;
+	elide = elideDuplicates;
+	failed = 0;
+	memset(&stats, 0, sizeof(stats));
+
+	if (fmt == CAPTURE_RAW)
+	{
+		CaptureHeader hdr = { CAPTURE_MAGIC, w, h, fps };
+		ok = fwrite(&hdr, sizeof(hdr), 1, file) == 1;
+	}
+	else
+		ok = fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 Cmono\n", w, h, fps) > 0;
+
+	buffers[0].used = buffers[1].used = 0;
+	current = &buffers[0];
+	queued = NULL;
+	/* spare starts at one: the buffer we are not filling is available */
+	if (!ok || !semaInit(&filled, 0) || !semaInit(&spare, 1) ||
+	    !threadStart(&writer, "capture_thread", 0x40, writerThread, NULL))
+	{
+		fclose(file);
+		file = NULL;
+		free(last);
+		return 0;
+	}
+	return 1;
+}
+
+int captureActive()
+{
+	return file != NULL;
+}
+
+void captureFrame(const u8 *display)
+{
+	u8 *out;
+	int i, n = width * height;
+
+	if (!file) return;
+	stats.frames++;
+
+	if (current->used + frameBytes > CAPTURE_BUFFER)
+		swapBuffers();
+	out = current->data + current->used;
+
+	if (format == CAPTURE_RAW)
+	{
+		u32 frame = stats.frames - 1;
+		memcpy(out, &frame, 4);
+		for (i = 0; i < n; i += 8)
+		{
+			u8 bits = (display[i] & 0x80) | (display[i+1] & 0x40) | (display[i+2] & 0x20) | (display[i+3] & 0x10) |
+			          (display[i+4] & 0x08) | (display[i+5] & 0x04) | (display[i+6] & 0x02) | (display[i+7] & 0x01);
+			out[4 + i / 8] = bits;
+		}
+	}
+	else
+	{
+		memcpy(out, "FRAME\n", 6);
+		memcpy(out + 6, display, n);
+	}
+
+	/* the frame stays in the buffer only if it differs from the last one kept */
+	out += headerBytes;
+	if (elide && stats.written && !memcmp(out, last, frameBytes - headerBytes)) return;
+	memcpy(last, out, frameBytes - headerBytes);
+	current->used += frameBytes;
+	stats.written++;
+}
+
+int captureClose(CaptureStats *result)
+{
+	if (!file) return 0;
+
+	if (current->used)
+		swapBuffers();
+	semaWait(&spare);       // writer finished the last buffer
+	queued = NULL;
+	semaSignal(&filled);
+	threadJoin(&writer);
+	semaDestroy(&filled);
+	semaDestroy(&spare);
+	if (fclose(file)) failed = 1;
+	file = NULL;
+	free(last);
+	if (result) *result = stats;
+	return !failed;
+}
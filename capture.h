@@ -0,0 +1,55 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <psptypes.h>
+
+/* Raw capture: a CaptureHeader, then for every frame that differs from the
+   one before it a u32 frame number followed by the frame at 1 bit per
+   pixel, MSB first, rows top to bottom. */
+#define CAPTURE_MAGIC 0x56523843    // "C8RV"
+
+enum { CAPTURE_RAW = 0, CAPTURE_Y4M = 1 };
+
+#define CAPTURE_BUFFER (128*1024)   // bytes per writer buffer
+
+typedef struct
+{
+	u32 magic;
+	u16 width, height;
+	u32 fps;
+} CaptureHeader;
+
+typedef struct
+{
+	u32 frames;     // frames offered to captureFrame
+	u32 written;    // frames that changed and were kept
+	u32 lost;       // kept frames a write error left out of the file
+	u32 stalls;     // times both buffers were full and we had to wait
+} CaptureStats;
+
+/**
+ * Start capturing to a file. Frames are written by a background thread.
+ *
+ * With CAPTURE_Y4M every changed frame becomes one monochrome Y4M frame,
+ * so when duplicates are elided the stream only holds the changes; pass
+ * elide=0 to get a constant frame rate video.
+ *
+ * @return 1 on success, 0 on failure
+ */
+extern int captureOpen(const char *szPath, int format, int width, int height, int fps, int elide);
+
+extern int captureActive();
+
+/**
+ * Offer one frame (one byte per pixel, 0xff lit) to the capture.
+ */
+extern void captureFrame(const u8 *display);
+
+/**
+ * Flush everything, stop the writer and close the file.
+ *
+ * @return 1 if every kept frame is in the file, 0 after a write error
+ */
+extern int captureClose(CaptureStats *stats);
+
+#endif
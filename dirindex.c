@@ -0,0 +1,263 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <pspkernel.h>
+
+#include "dirindex.h"
+
+#define ARENA_CHUNK 16384
+
+void dirindexInit(DIRINDEX *idx)
+{
+	memset(idx, 0, sizeof(DIRINDEX));
+#ifdef LOWMEM
+	arenaInitFixed(&idx->arena, idx->arenaSpace, sizeof(idx->arenaSpace));
+#else
+	arenaInit(&idx->arena, ARENA_CHUNK);
+#endif
+	idx->fd = -1;
+}
+
+static int entryCompare(const DIRENTRY *a, const DIRENTRY *b)
+{
+	/* parent first, then directories and packs, then files */
+	static const int rank[] = { 2, 1, 0, 1 };
+	if (rank[a->Type] != rank[b->Type])
+		return rank[a->Type] - rank[b->Type];
+	return strcasecmp(a->szName, b->szName);
+}
+
+static int qsortCompare(const void *a, const void *b)
+{
+	return entryCompare(*(DIRENTRY* const*)a, *(DIRENTRY* const*)b);
+}
+
+static int reserve(DIRINDEX *idx, int n)
+{
+#ifdef LOWMEM
+	/* fixed room: a page only fills what is left of it */
+	idx->order = idx->orderSpace;
+	idx->view = idx->viewSpace;
+	idx->capacity = DIRINDEX_MAX;
+	return idx->count < DIRINDEX_MAX || n <= DIRINDEX_MAX;
+#else
+	int cap = idx->capacity ? idx->capacity : DIRINDEX_PAGE;
+	DIRENTRY **p;
+
+	if (n <= idx->capacity) return 1;
+	while (cap < n) cap *= 2;
+
+	if (!(p = (DIRENTRY**) realloc(idx->order, cap * sizeof(DIRENTRY*)))) return 0;
+	idx->order = p;
+	if (!(p = (DIRENTRY**) realloc(idx->view, cap * sizeof(DIRENTRY*)))) return 0;
+	idx->view = p;
+	idx->capacity = cap;
+	return 1;
+#endif
+}
+
+static int matches(const char *szName, const char *szFilter)
+{
+	const char *s, *f;
+	if (!*szFilter) return 1;
+	for (; *szName; szName++)
+	{
+		for (s = szName, f = szFilter; *f && tolower((unsigned char)*s) == tolower((unsigned char)*f); s++, f++)
+			;
+		if (!*f) return 1;
+	}
+	return 0;
+}
+
+static int shown(const DIRINDEX *idx, const DIRENTRY *e)
+{
+	return e->Type == DIRENT_PARENT || matches(e->szName, idx->szFilter);
+}
+
+static void refilter(DIRINDEX *idx, DIRENTRY **from, int n)
+{
+	int i, k = 0;
+	for (i = 0; i < n; i++)
+		if (shown(idx, from[i]))
+			idx->view[k++] = from[i];
+	idx->viewCount = k;
+}
+
+/* Every page was sorted on its own as it came in, and all but the last
+   are DIRINDEX_PAGE long. Merge them bottom up into one sorted run, with
+   view as the second buffer since it is rebuilt afterwards anyway. */
+static void mergePages(DIRINDEX *idx)
+{
+	DIRENTRY **from = idx->order, **to = idx->view, **t;
+	int base = idx->firstPage, width, lo, mid, hi, i, j, k;
+
+	for (width = DIRINDEX_PAGE; base + width < idx->count; width *= 2)
+	{
+		for (lo = base; lo < idx->count; lo = hi)
+		{
+			mid = lo + width < idx->count ? lo + width : idx->count;
+			hi = mid + width < idx->count ? mid + width : idx->count;
+			for (i = lo, j = mid, k = lo; k < hi; k++)
+				to[k] = (j >= hi || (i < mid && entryCompare(from[i], from[j]) <= 0)) ? from[i++] : from[j++];
+		}
+		t = from;
+		from = to;
+		to = t;
+	}
+	if (from != idx->order)
+		memcpy(idx->order + base, from + base, (idx->count - base) * sizeof(DIRENTRY*));
+}
+
+static void closeDir(DIRINDEX *idx)
+{
+	if (idx->fd >= 0) sceIoDclose(idx->fd);
+	idx->fd = -1;
+	rompackClose(&idx->pack);
+}
+
+static int loading(const DIRINDEX *idx)
+{
+	return idx->fd >= 0 || idx->pack.file;
+}
+
+/* the directory is read: sort it as a whole */
+static void finishLoad(DIRINDEX *idx)
+{
+	closeDir(idx);
+	if (idx->count - idx->firstPage > DIRINDEX_PAGE)
+	{
+		mergePages(idx);
+		refilter(idx, idx->order, idx->count);
+	}
+}
+
+int dirindexOpen(DIRINDEX *idx, const char *szPath)
+{
+	if (rompackIsPack(szPath))
+	{
+		RomPack pack;
+		if (!rompackOpen(&pack, szPath)) return 0;
+		closeDir(idx);
+		idx->pack = pack;
+		idx->packNext = 0;
+	}
+	else
+	{
+		int fd = sceIoDopen(szPath);
+		if (fd < 0) return 0;
+		closeDir(idx);
+		idx->fd = fd;
+	}
+	arenaReset(&idx->arena);
+	idx->count = idx->viewCount = 0;
+	idx->szFilter[0] = 0;
+	strncpy(idx->szPath, szPath, DIRINDEX_PATH - 1);
+	idx->szPath[DIRINDEX_PATH - 1] = 0;
+
+	if (strcmp(szPath, "ms0:") && reserve(idx, 1))
+	{
+		DIRENTRY *e = (DIRENTRY*) arenaAlloc(&idx->arena, sizeof(DIRENTRY));
+		if (e)
+		{
+			e->Type = DIRENT_PARENT;
+			e->szName = "..";
+			idx->order[idx->count++] = e;
+		}
+	}
+	idx->firstPage = idx->count;
+	refilter(idx, idx->order, idx->count);
+	return 1;
+}
+
+int dirindexLoad(DIRINDEX *idx)
+{
+	SceIoDirent g_dir;
+	DIRENTRY **page;
+	int n = 0, i;
+
+	if (!loading(idx)) return 0;
+	if (!reserve(idx, idx->count + DIRINDEX_PAGE))
+	{
+		finishLoad(idx);
+		return 0;
+	}
+
+	/* collect a page behind the loaded entries */
+	page = idx->order + idx->count;
+	memset(&g_dir, 0, sizeof(SceIoDirent));
+	while (n < DIRINDEX_PAGE && idx->count + n < idx->capacity)
+	{
+		DIRENTRY *e;
+		const char *szName;
+		int type;
+		if (idx->pack.file)
+		{
+			/* the pack index is already in memory */
+			if (idx->packNext >= idx->pack.count) break;
+			szName = idx->pack.entries[idx->packNext++].name;
+			type = DIRENT_FILE;
+		}
+		else
+		{
+			if (sceIoDread(idx->fd, &g_dir) <= 0) break;
+			if (g_dir.d_name[0] == '.') continue;
+			szName = g_dir.d_name;
+			type = FIO_S_ISDIR(g_dir.d_stat.st_mode) ? DIRENT_DIR :
+			       rompackIsPack(szName) ? DIRENT_PACK : DIRENT_FILE;
+		}
+		e = (DIRENTRY*) arenaAlloc(&idx->arena, sizeof(DIRENTRY));
+		if (!e || !(e->szName = arenaStrdup(&idx->arena, szName))) break;
+		e->Type = type;
+		page[n++] = e;
+	}
+
+	/* sort the page and show what matches behind the others */
+	qsort(page, n, sizeof(DIRENTRY*), qsortCompare);
+	for (i = 0; i < n; i++)
+		if (shown(idx, page[i]))
+			idx->view[idx->viewCount++] = page[i];
+	idx->count += n;
+
+	if (n == DIRINDEX_PAGE) return 1;
+	finishLoad(idx);
+	return 0;
+}
+
+void dirindexFilter(DIRINDEX *idx, const char *szFilter)
+{
+	int narrow = !strncmp(szFilter, idx->szFilter, strlen(idx->szFilter));
+
+	strncpy(idx->szFilter, szFilter, DIRINDEX_FILTER - 1);
+	idx->szFilter[DIRINDEX_FILTER - 1] = 0;
+	if (narrow)
+		refilter(idx, idx->view, idx->viewCount);
+	else
+		refilter(idx, idx->order, idx->count);
+}
+
+void dirindexPath(const DIRINDEX *idx, int n, char *szOut, int size)
+{
+	char *p;
+
+	if (idx->view[n]->Type != DIRENT_PARENT)
+	{
+		snprintf(szOut, size, "%s/%s", idx->szPath, idx->view[n]->szName);
+		return;
+	}
+	strncpy(szOut, idx->szPath, size - 1);
+	szOut[size - 1] = 0;
+	if ((p = strrchr(szOut, '/'))) *p = 0;
+}
+
+void dirindexFree(DIRINDEX *idx)
+{
+	closeDir(idx);
+	arenaFree(&idx->arena);
+#ifndef LOWMEM
+	free(idx->order);
+	free(idx->view);
+#endif
+	dirindexInit(idx);
+}
@@ -0,0 +1,75 @@
+#ifndef DIRINDEX_H
+#define DIRINDEX_H
+
+#include "arena.h"
+#include "rompack.h"
+
+#define DIRINDEX_PAGE 256        // entries read per dirindexLoad call
+#define DIRINDEX_PATH 256
+#define DIRINDEX_FILTER 32
+#ifdef LOWMEM
+#define DIRINDEX_MAX 1024        // entries listed per directory
+#define DIRINDEX_NAMES 32768     // bytes for them and their names
+#endif
+
+enum { DIRENT_FILE = 0, DIRENT_DIR = 1, DIRENT_PARENT = 2, DIRENT_PACK = 3 };
+
+typedef struct
+{
+	int Type;
+	char *szName;
+} DIRENTRY;
+
+typedef struct
+{
+	char szPath[DIRINDEX_PATH];
+	char szFilter[DIRINDEX_FILTER];
+	Arena arena;          // entries and names of the current directory
+	DIRENTRY **order;     // all loaded entries, sorted page by page until complete
+	DIRENTRY **view;      // entries matching szFilter
+	int count, capacity;
+	int firstPage;        // entries in order before the first page
+	int viewCount;
+	int fd;               // open directory handle while still loading
+	RomPack pack;         // open pack while listing one
+	int packNext;         // next pack entry to list
+#ifdef LOWMEM
+	DIRENTRY *orderSpace[DIRINDEX_MAX];
+	DIRENTRY *viewSpace[DIRINDEX_MAX];
+	void *arenaSpace[DIRINDEX_NAMES / sizeof(void*)];
+#endif
+} DIRINDEX;
+
+extern void dirindexInit(DIRINDEX *idx);
+
+/**
+ * Switch to another directory, or to the listing of a ROM pack. Nothing is read yet, call dirindexLoad
+ * until it returns 0.
+ *
+ * @return 1 on success, 0 if the directory cannot be opened
+ */
+extern int dirindexOpen(DIRINDEX *idx, const char *szPath);
+
+/**
+ * Read the next DIRINDEX_PAGE entries, sort them and list them behind the
+ * ones before. Once the directory is complete the pages are merged into
+ * one sorted listing, so a directory of n entries costs O(n log n).
+ *
+ * @return 1 while more entries may follow, 0 once the directory is complete
+ */
+extern int dirindexLoad(DIRINDEX *idx);
+
+/**
+ * Show only entries whose name contains szFilter, case insensitively.
+ * When the new filter extends the old one only the current view is searched.
+ */
+extern void dirindexFilter(DIRINDEX *idx, const char *szFilter);
+
+/**
+ * Build the full path of a visible entry into szOut.
+ */
+extern void dirindexPath(const DIRINDEX *idx, int n, char *szOut, int size);
+
+extern void dirindexFree(DIRINDEX *idx);
+
+#endif
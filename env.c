@@ -0,0 +1,213 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "env.h"
+
+enum { JOB_RESET, JOB_STEP, JOB_QUIT };
+
+/* on the calling thread's core */
+static void resetMachine(Env *env, int n, u32 seed)
+{
+	chip8_iperiod = env->iperiod;
+	chip8_quirks = env->quirks;
+	/* chip8_reset leaves the RAM of the machine this core ran before */
+	memset(chip8_mem, 0, sizeof(chip8_mem));
+	chip8_reset();
+	memcpy(chip8_mem + 0x200, env->rom, env->romSize);
+	chip8_rng = seed;
+#ifdef CHIP8_HASH
+	chip8_rehash();
+#endif
+	chip8_save_state(&env->state[n]);
+	env->reward[n] = 0;
+	env->done[n] = 0;
+	env->memo[n] = 0;
+	if (env->rewardFunc)
+		env->rewardFunc(&env->state[n], &env->memo[n], env->rewardArg);
+}
+
+static void stepMachine(Env *env, int n)
+{
+	struct chip8_state *s = &env->state[n];
+	int f;
+
+	if (env->done[n]) return;
+	chip8_load_state(s);
+	chip8_keys = env->actions ? env->actions[n] : 0;
+	for (f = 0; f < env->frameskip && chip8_running == 1; f++)
+		chip8_frame();
+	chip8_save_state(s);
+	env->done[n] = chip8_running != 1;
+	env->reward[n] = env->rewardFunc ? env->rewardFunc(s, &env->memo[n], env->rewardArg) : 0;
+}
+
+/* machines from..to-1 */
+static void runJob(Env *env, int from, int to)
+{
+	int n;
+	chip8_iperiod = env->iperiod;
+	chip8_quirks = env->quirks;
+	chip8_run_mask = 0;
+	for (n = from; n < to; n++)
+	{
+		if (env->job == JOB_RESET)
+			resetMachine(env, n, env->seeds ? env->seeds[n] : (u32)n);
+		else
+			stepMachine(env, n);
+	}
+}
+
+static int workerThread(void *arg)
+{
+	EnvWorker *w = (EnvWorker*) arg;
+	Env *env = w->env;
+
+	for (;;)
+	{
+		semaWait(&env->go[w->index]);
+		if (env->job == JOB_QUIT) break;
+		runJob(env, (int)((long long)env->count * w->index / env->threads),
+		       (int)((long long)env->count * (w->index + 1) / env->threads));
+		semaSignal(&env->finished);
+	}
+	return 0;
+}
+
+/* run the current job on every machine and wait for it */
+static void fanOut(Env *env)
+{
+	int w;
+	if (!env->threads)
+	{
+		runJob(env, 0, env->count);
+		return;
+	}
+	for (w = 0; w < env->threads; w++)
+		semaSignal(&env->go[w]);
+	for (w = 0; w < env->threads; w++)
+		semaWait(&env->finished);
+}
+
+int envInit(Env *env, int count, int threads, const u8 *rom, int size, u8 iperiod, u8 quirks)
+{
+	int w;
+
+	memset(env, 0, sizeof(*env));
+	if (count < 1 || size < 1 || size > (int)sizeof(env->rom) || threads > ENV_THREADS_MAX) return 0;
+#ifndef CHIP8_THREADS
+	threads = 0;    // one core, one thread
+#endif
+	if (threads < 2) threads = 0;
+	if (threads > count) threads = count;
+
+	env->count = count;
+	env->state = (struct chip8_state*) calloc(count, sizeof(struct chip8_state));
+	env->reward = (float*) calloc(count, sizeof(float));
+	env->done = (u8*) calloc(count, 1);
+	env->memo = (u32*) calloc(count, sizeof(u32));
+	if (!env->state || !env->reward || !env->done || !env->memo)
+	{
+		envFree(env);
+		return 0;
+	}
+	memcpy(env->rom, rom, size);
+	env->romSize = size;
+	env->iperiod = iperiod;
+	env->quirks = quirks;
+
+	if (threads && !semaInit(&env->finished, 0))
+		threads = 0;
+	for (w = 0; w < threads; w++)
+	{
+		env->worker[w].env = env;
+		env->worker[w].index = w;
+		if (!semaInit(&env->go[w], 0)) break;
+		if (!threadStart(&env->thread[w], "env_worker", 0x30, workerThread, &env->worker[w]))
+		{
+			semaDestroy(&env->go[w]);
+			break;
+		}
+	}
+	env->threads = w;
+	if (threads && w < threads)
+	{
+		envFree(env);
+		return 0;
+	}
+	return 1;
+}
+
+void envFree(Env *env)
+{
+	int w;
+
+	if (env->threads)
+	{
+		env->job = JOB_QUIT;
+		for (w = 0; w < env->threads; w++)
+			semaSignal(&env->go[w]);
+		for (w = 0; w < env->threads; w++)
+		{
+			threadJoin(&env->thread[w]);
+			semaDestroy(&env->go[w]);
+		}
+		semaDestroy(&env->finished);
+	}
+	free(env->state);
+	free(env->reward);
+	free(env->done);
+	free(env->memo);
+	memset(env, 0, sizeof(*env));
+}
+
+void envSetReward(Env *env, EnvReward func, void *arg)
+{
+	env->rewardFunc = func;
+	env->rewardArg = arg;
+}
+
+float envScoreReward(const struct chip8_state *state, u32 *memo, void *arg)
+{
+	const EnvScore *score = (const EnvScore*) arg;
+	u32 value = 0;
+	int d;
+	float reward;
+
+	if (!score->digits)
+		value = state->mem[score->addr & 4095];
+	for (d = 0; d < score->digits; d++)
+		value = value * 10 + state->mem[(score->addr + d) & 4095];
+	reward = (float)value - (float)*memo;
+	*memo = value;
+	return reward;
+}
+
+void envReset(Env *env, const u32 *seeds)
+{
+	env->job = JOB_RESET;
+	env->seeds = seeds;
+	fanOut(env);
+}
+
+void envResetOne(Env *env, int n, u32 seed)
+{
+	resetMachine(env, n, seed);
+}
+
+void envStep(Env *env, const u16 *actions, int frameskip)
+{
+	int n, running = 0;
+
+	for (n = 0; n < env->count; n++)
+		running += !env->done[n];
+	env->job = JOB_STEP;
+	env->actions = actions;
+	env->frameskip = frameskip;
+	fanOut(env);
+	env->frames += (u64)running * frameskip;
+}
+
+const u8* envObservation(const Env *env, int n)
+{
+	return env->state[n].display;
+}
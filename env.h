@@ -0,0 +1,117 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <psptypes.h>
+#include "CHIP8.h"
+#include "thread.h"
+
+/* A batch of machines for reinforcement learning, stepped together by a
+   pool of worker threads. Every machine lives in its own chip8_state; a
+   worker loads it into the core, runs the frames and stores it back, so
+   each step copies the memory and display of a machine in and out once
+   (see envbench for what that costs). An observation then points at the
+   stored display and needs no further copy. The core must be built with CHIP8_THREADS for the
+   workers to run side by side, each in its own copy of it; without it
+   the batch is stepped on the calling thread. */
+
+#define ENV_THREADS_MAX 64
+
+/**
+ * Reward of one machine after a step, read from its guest memory or
+ * registers. memo keeps what the hook needs between steps, e.g. the last
+ * score; it is cleared and the hook called once when the machine resets.
+ */
+typedef float (*EnvReward)(const struct chip8_state *state, u32 *memo, void *arg);
+
+typedef struct
+{
+	u16 addr;       // where the game keeps its score
+	u8 digits;      // 0: a byte, n: n BCD digits as Fx33 stores them
+} EnvScore;
+
+typedef struct Env Env;
+
+typedef struct
+{
+	Env *env;
+	int index;
+} EnvWorker;
+
+struct Env
+{
+	int count;
+	struct chip8_state *state;  // one machine each
+	float *reward;              // from the last step
+	u8 *done;                   // chip8_running left 1
+	u32 *memo;                  // per machine, for the reward hook
+	EnvReward rewardFunc;
+	void *rewardArg;
+	u8 iperiod, quirks;
+	u8 rom[4096 - 0x200];
+	int romSize;
+	u64 frames;                 // machine frames run by all steps
+
+	/* the pool */
+	int threads;                // 0: step on the calling thread
+	Thread thread[ENV_THREADS_MAX];
+	EnvWorker worker[ENV_THREADS_MAX];
+	Sema go[ENV_THREADS_MAX];
+	Sema finished;
+	int job;
+	const u32 *seeds;
+	const u16 *actions;
+	int frameskip;
+};
+
+/**
+ * Load a ROM into count machines and start the worker threads. The
+ * machines still need an envReset.
+ *
+ * @param threads - workers, at most ENV_THREADS_MAX; 0 or 1 steps on the
+ * calling thread
+ *
+ * @return 1 on success, 0 on failure
+ */
+extern int envInit(Env *env, int count, int threads, const u8 *rom, int size, u8 iperiod, u8 quirks);
+
+extern void envFree(Env *env);
+
+/**
+ * @param func - NULL for no reward
+ */
+extern void envSetReward(Env *env, EnvReward func, void *arg);
+
+/**
+ * Reward hook for a score in guest memory: the change since the last
+ * step. arg is an EnvScore.
+ */
+extern float envScoreReward(const struct chip8_state *state, u32 *memo, void *arg);
+
+/**
+ * Restart every machine from the ROM.
+ *
+ * @param seeds - random number seed per machine, NULL for the machine's index
+ */
+extern void envReset(Env *env, const u32 *seeds);
+
+/**
+ * Restart one machine, e.g. once it is done. Runs on the calling thread.
+ */
+extern void envResetOne(Env *env, int n, u32 seed);
+
+/**
+ * Hold the given keys and run frameskip frames on every machine that is
+ * not done, then fill in reward and done.
+ *
+ * @param actions - key mask per machine, bit n for CHIP8 key n; NULL for none
+ */
+extern void envStep(Env *env, const u16 *actions, int frameskip);
+
+/**
+ * @return the display of machine n as the last step or reset stored it,
+ * CHIP8_WIDTH*CHIP8_HEIGHT bytes of 0 or 0xff; successive machines are
+ * sizeof(struct chip8_state) apart
+ */
+extern const u8* envObservation(const Env *env, int n);
+
+#endif
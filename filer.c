@@ -5,111 +5,135 @@
 #include <pspdebug.h>
 #include "graphics.h"
 #include "filer.h"
+#include "dirindex.h"
+#include "romcache.h"
 #include "controller.h"
+#include "footprint.h"
 
-typedef struct
-{
-	int Type; //0=regular file, 1=dir, 2=..
-	char *szPath;
-} DIRENTRY;
-
-int findDirEntries(char *szDirname, DIRENTRY * dirEnt) 
-{  
-	SceIoDirent g_dir;
-	int fd = sceIoDopen(szDirname); 
-	if (fd < 0)
-		return 0;  
+#define PREFETCH_AROUND 2	/* neighbours of the selection to prefetch */
 
-	memset(&g_dir, 0, sizeof(SceIoDirent));  
+/* queue the selected ROM and the ones around it for background loading */
+static void prefetchAround(DIRINDEX *dir, int sel)
+{
+	static char szPaths[PREFETCH_AROUND*2+1][DIRINDEX_PATH*2];
+	const char *paths[PREFETCH_AROUND*2+1];
+	int n = 0;
 
-	int i = 0;
-	if(strcmp(szDirname, "ms0:"))
+	for(int d=0; d<=PREFETCH_AROUND*2; d++)
 	{
-	  dirEnt[0].Type = 2;
-	  dirEnt[0].szPath = (char*)malloc(strlen(szDirname)+(strlen("..")+1)*sizeof(char)); 
-    sprintf(dirEnt[0].szPath, "%s/..", szDirname);
-    i++;
-  }
-	
-
-	while (sceIoDread(fd, &g_dir)) 
-	{  
-		if(g_dir.d_name[0]=='.') continue;
-		dirEnt[i].Type = FIO_S_ISDIR(g_dir.d_stat.st_mode);
-		  
-		dirEnt[i].szPath = (char*)malloc(strlen(szDirname)+(strlen(g_dir.d_name)+1)*sizeof(char)); 
-		sprintf(dirEnt[i].szPath, "%s/%s", szDirname, g_dir.d_name);
-		i++; 
-	} 
-	sceIoDclose(fd); 
-	return i;
+		/* sel, sel+1, sel-1, sel+2, ... */
+		int i = sel + ((d&1) ? (d+1)/2 : -(d/2));
+		if(i < 0 || i >= dir->viewCount || dir->view[i]->Type != DIRENT_FILE) continue;
+		dirindexPath(dir, i, szPaths[n], sizeof(szPaths[n]));
+		paths[n] = szPaths[n];
+		n++;
+	}
+	romcachePrefetch(paths, n);
 }
 
-void bubble_sort(int numItems)
-{
-	
-}
+/* characters offered for type-to-filter, picked with the shoulder buttons */
+static const char filterChars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
 
 void FileBrowser(char *szStartDir)
 {
 	const int row = 30;
 	int sel = 0, srow = 0;
 	
-	char curPath[256];
-	strcpy(curPath, szStartDir);
+	static DIRINDEX dir;
+	char szSel[DIRINDEX_PATH*2];
+	char szFilter[DIRINDEX_FILTER] = "";
+	int filterLen = 0, filterChar = 0;
+	int prefetched = -1, prefetchedCount = -1;
 
-	DIRENTRY curDir[256];
-	int numEnt = findDirEntries(szStartDir, curDir);
+	dirindexInit(&dir);
+	dirindexOpen(&dir, szStartDir);
 	while(1)
 	{
+		/* keep reading the directory a page per frame while browsing; the
+		   last page merges the listing, so follow the selected entry to
+		   where it ends up and keep it on the same screen row */
+		DIRENTRY *selected = sel < dir.viewCount ? dir.view[sel] : NULL;
+		dirindexLoad(&dir);
+		if(selected && (sel >= dir.viewCount || dir.view[sel] != selected))
+		{
+			for(int i=0;i<dir.viewCount;i++)
+				if(dir.view[i] == selected)
+				{
+					srow += i - sel;
+					sel = i;
+					break;
+				}
+		}
+
 		readpad();
-		if(new_pad & PSP_CTRL_CROSS)
+		if((new_pad & PSP_CTRL_CROSS) && sel < dir.viewCount)
 		{
-			if(curDir[sel].Type==0)
+			dirindexPath(&dir, sel, szSel, sizeof(szSel));
+			if(dir.view[sel]->Type==DIRENT_FILE)
 			{  
-				Emulate(curDir[sel].szPath);
+				Emulate(szSel);
 			}
-			else if(curDir[sel].Type==2)
-			{ 
-				char *p = strrchr(curDir[sel].szPath, '/');
-				if(p)
-				{
-				  *p = 0;
-				  p = strrchr(curDir[sel].szPath, '/');
-				  *p = 0;
-				  strcpy(curPath, curDir[sel].szPath);
-				  numEnt = findDirEntries(curDir[sel].szPath, curDir);
-				  sel = 0;
-				}
-			}else{
-				strcpy(curPath, curDir[sel].szPath);
-				numEnt = findDirEntries(curDir[sel].szPath, curDir); 
+			else if(dirindexOpen(&dir, szSel))
+			{
 				sel = 0;
+				szFilter[filterLen = 0] = 0;
+			}
+		}
+
+		if(new_pad & (PSP_CTRL_SQUARE|PSP_CTRL_TRIANGLE|PSP_CTRL_LTRIGGER|PSP_CTRL_RTRIGGER))
+		{
+			const int nChars = sizeof(filterChars)-1;
+			if((new_pad & PSP_CTRL_SQUARE) && filterLen < DIRINDEX_FILTER-1)
+			{
+				filterChar = 0;
+				szFilter[filterLen++] = filterChars[filterChar];
+			}
+			if((new_pad & PSP_CTRL_TRIANGLE) && filterLen > 0)
+				filterLen--;
+			if((new_pad & (PSP_CTRL_LTRIGGER|PSP_CTRL_RTRIGGER)) && filterLen > 0)
+			{
+				filterChar += (new_pad & PSP_CTRL_RTRIGGER) ? 1 : nChars-1;
+				filterChar %= nChars;
+				szFilter[filterLen-1] = filterChars[filterChar];
 			}
+			szFilter[filterLen] = 0;
+			dirindexFilter(&dir, szFilter);
+			sel = 0;
 		}
+
 		if(new_pad & PSP_CTRL_DOWN) sel++;
 		if(new_pad & PSP_CTRL_UP) sel--;
 
-
+		int numEnt = dir.viewCount;
 		if(sel >= numEnt)		sel=0;
 		if(sel < 0)				sel=numEnt-1;
 		if(srow > numEnt-row)	srow=numEnt-row;
 		if(srow < 0)				srow=0;
 		if(sel >= srow+row)		srow=sel-row+1;
 		if(sel < srow)			srow=sel;
+
+		if(sel != prefetched || numEnt != prefetchedCount)
+		{
+			prefetchAround(&dir, sel);
+			prefetched = sel;
+			prefetchedCount = numEnt;
+		}
 		
 		clearScreen(0x00);
 		
-		printTextf(0, 0, RGB(255,255,255), "%s", curPath);
+		if(filterLen)
+			printTextf(0, 0, RGB(255,255,255), "%s  [%s]", dir.szPath, szFilter);
+		else
+			printTextf(0, 0, RGB(255,255,255), "%s", dir.szPath);
 		
 		for(int i=0;i<row;i++)
 		{  
-			if(i>=numEnt) break;
-			char *p = strrchr(curDir[i+srow].szPath, '/');
-			printTextf(4, (i*8)+16, sel==i+srow?RGB(255,255,255):RGB(200,200,200), "%s%s", (p)?(p+1):(curDir[i+i].szPath), curDir[i+srow].Type==1?"/":"");
+			if(i+srow>=numEnt) break;
+			DIRENTRY *e = dir.view[i+srow];
+			printTextf(4, (i*8)+16, sel==i+srow?RGB(255,255,255):RGB(200,200,200), "%s%s", e->szName, (e->Type==DIRENT_DIR||e->Type==DIRENT_PACK)?"/":"");
 		}
 		sceDisplayWaitVblankStart();
 		flipScreen();
+		footprintSample();
 	}
 }
-
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <malloc.h>
+
+#include "footprint.h"
+
+#ifdef LOWMEM
+
+static Footprint fp;
+
+static u32 heapInUse(void)
+{
+	struct mallinfo mi = mallinfo();
+	return (u32)mi.uordblks;
+}
+
+void footprintStartup()
+{
+	fp.startup = fp.peak = heapInUse();
+	fp.samples = fp.grownAt = 0;
+}
+
+void footprintSample()
+{
+	u32 used = heapInUse();
+	if (used > fp.peak) fp.peak = used;
+	if (used > fp.startup) fp.grownAt++;
+	fp.samples++;
+}
+
+const Footprint* footprintGet()
+{
+	return &fp;
+}
+
+int footprintWrite(const char *szPath)
+{
+	FILE *file = fopen(szPath, "w");
+	if (!file) return 0;
+	fprintf(file, "heap at startup  %u bytes\n", (unsigned)fp.startup);
+	fprintf(file, "peak heap        %u bytes\n", (unsigned)fp.peak);
+	fprintf(file, "after startup    +%u bytes\n", (unsigned)(fp.peak - fp.startup));
+	fprintf(file, "samples          %u, %u above startup\n", (unsigned)fp.samples, (unsigned)fp.grownAt);
+	return fclose(file) == 0;
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef FOOTPRINT_H
+#define FOOTPRINT_H
+
+#include <psptypes.h>
+
+/* Heap use of the running emulator, to check the budget of a LOWMEM
+   build. The static part is reported at build time by "make footprint".
+   Other builds do not track it: the calls compile to nothing there. */
+
+#ifdef LOWMEM
+
+typedef struct
+{
+	u32 startup;     // bytes in use when footprintStartup was called
+	u32 peak;        // most bytes in use at any sample
+	u32 samples;
+	u32 grownAt;     // samples that found more in use than at startup
+} Footprint;
+
+/**
+ * Startup is over: what is in use now is the baseline.
+ */
+extern void footprintStartup();
+
+/**
+ * Note the heap in use, e.g. once per frame.
+ */
+extern void footprintSample();
+
+extern const Footprint* footprintGet();
+
+/**
+ * Write the heap figures as text.
+ *
+ * @return 1 on success, 0 on failure
+ */
+extern int footprintWrite(const char *szPath);
+
+#else
+
+#define footprintStartup()
+#define footprintSample()
+
+#endif
+
+#endif
@@ -0,0 +1,39 @@
+#include "frameskip.h"
+
+/* exponential moving average with weight 1/8 for the new sample */
+#define SMOOTH(avg, sample) ((avg) = ((avg) * 7 + (sample)) / 8)
+
+void frameskipInit(FrameSkip *fs, int maxSkip)
+{
+	fs->emuCost = 0;
+	fs->renderCost = 0;
+	fs->maxSkip = maxSkip;
+	fs->skipRun = 0;
+	fs->presented = 0;
+	fs->skipped = 0;
+}
+
+int frameskipPresent(FrameSkip *fs, u64 now, u64 deadline)
+{
+	u64 needed = fs->renderCost + fs->emuCost;
+
+	if (fs->skipRun < fs->maxSkip && (now >= deadline || deadline - now < needed))
+	{
+		fs->skipRun++;
+		fs->skipped++;
+		return 0;
+	}
+	fs->skipRun = 0;
+	fs->presented++;
+	return 1;
+}
+
+void frameskipEmulated(FrameSkip *fs, u64 ns)
+{
+	SMOOTH(fs->emuCost, ns);
+}
+
+void frameskipRendered(FrameSkip *fs, u64 ns)
+{
+	SMOOTH(fs->renderCost, ns);
+}
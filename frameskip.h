@@ -0,0 +1,34 @@
+#ifndef FRAMESKIP_H
+#define FRAMESKIP_H
+
+#include <psptypes.h>
+
+typedef struct
+{
+	u64 emuCost;     // smoothed time spent emulating one timeslice, ns
+	u64 renderCost;  // smoothed time spent presenting one frame, ns
+	int maxSkip;     // never skip more than this many frames in a row
+	int skipRun;     // frames skipped since the last presented one
+	u32 presented;
+	u32 skipped;
+} FrameSkip;
+
+extern void frameskipInit(FrameSkip *fs, int maxSkip);
+
+/**
+ * Decide whether to present the current frame. Emulation always runs;
+ * only presentation is dropped, and only while the time left until the
+ * next deadline is shorter than it takes to render plus emulate a frame.
+ *
+ * @param now - current time in ns
+ * @param deadline - time the current frame has to be finished by, in ns
+ *
+ * @return 1 to present, 0 to skip
+ */
+extern int frameskipPresent(FrameSkip *fs, u64 now, u64 deadline);
+
+extern void frameskipEmulated(FrameSkip *fs, u64 ns);
+
+extern void frameskipRendered(FrameSkip *fs, u64 ns);
+
+#endif
@@ -0,0 +1,513 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <psptypes.h>
+
+#include "CHIP8.h"
+#include "gdbstub.h"
+#include "thread.h"
+
+#define PACKET_MAX 0x1000           // payload, as advertised in qSupported
+#define NUM_REGS 21
+#define REG_BYTES 24
+
+static int listenSock = -1;
+static int conn = -1;
+static volatile int connected, quit;
+static int noAck;
+static Thread server;
+
+static Sema sendLock, snapLock;     // used as mutexes
+static Sema request, done;          // mailbox to the emulation thread
+static char mailbox[PACKET_MAX + 1];
+
+/* owned by snapLock */
+static struct chip8_state snapshot;
+static char stopReply[32] = "S05";
+
+/* emulation thread only */
+static byte watchFlags[4096];
+static int interrupted, resumed;
+
+static char targetXml[2048];
+static const char hexDigits[] = "0123456789abcdef";
+
+static void buildTargetXml(void)
+{
+	char *p = targetXml;
+	int n;
+
+	p += sprintf(p, "<?xml version=\"1.0\"?>\n<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+	                "<target version=\"1.0\">\n<feature name=\"org.chip8.core\">\n");
+	for (n = 0; n < 16; n++)
+		p += sprintf(p, "<reg name=\"v%x\" bitsize=\"8\" type=\"uint8\" regnum=\"%d\"/>\n", n, n);
+	sprintf(p, "<reg name=\"i\" bitsize=\"16\" type=\"data_ptr\"/>\n"
+	           "<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>\n"
+	           "<reg name=\"sp\" bitsize=\"16\" type=\"data_ptr\"/>\n"
+	           "<reg name=\"dt\" bitsize=\"8\" type=\"uint8\"/>\n"
+	           "<reg name=\"st\" bitsize=\"8\" type=\"uint8\"/>\n"
+	           "</feature>\n</target>\n");
+}
+
+static int hexValue(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static char* toHex(char *out, const u8 *data, int len)
+{
+	for (; len > 0; len--, data++)
+	{
+		*out++ = hexDigits[*data >> 4];
+		*out++ = hexDigits[*data & 15];
+	}
+	*out = 0;
+	return out;
+}
+
+static int fromHex(u8 *out, const char *in, int len)
+{
+	int i;
+	for (i = 0; i < len; i++)
+	{
+		int hi = hexValue(in[2*i]), lo = hexValue(in[2*i+1]);
+		if (hi < 0 || lo < 0) return 0;
+		out[i] = (u8)(hi << 4 | lo);
+	}
+	return 1;
+}
+
+static void putPacket(const char *data)
+{
+	static char buf[PACKET_MAX * 2 + 8];
+	int n = strlen(data), sum = 0, i;
+
+	semaWait(&sendLock);
+	buf[0] = '$';
+	for (i = 0; i < n; i++)
+	{
+		buf[i+1] = data[i];
+		sum += (u8)data[i];
+	}
+	sprintf(buf + n + 1, "#%02x", sum & 0xff);
+	if (conn >= 0)
+		send(conn, buf, n + 4, MSG_NOSIGNAL);
+	semaSignal(&sendLock);
+}
+
+/* 'g' layout: v0-vf, i, pc, sp, dt, st */
+static void packRegs(u8 *out, const struct chip8_regs_struct *regs)
+{
+	memcpy(out, regs->alg, 16);
+	out[16] = regs->i; out[17] = regs->i >> 8;
+	out[18] = regs->pc; out[19] = regs->pc >> 8;
+	out[20] = regs->sp; out[21] = regs->sp >> 8;
+	out[22] = regs->delay;
+	out[23] = regs->sound;
+}
+
+static void unpackRegs(struct chip8_regs_struct *regs, const u8 *in)
+{
+	memcpy(regs->alg, in, 16);
+	regs->i = in[16] | in[17] << 8;
+	regs->pc = in[18] | in[19] << 8;
+	regs->sp = in[20] | in[21] << 8;
+	regs->delay = in[22];
+	regs->sound = in[23];
+}
+
+static const int regOffset[NUM_REGS + 1] = { 0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15, 16, 18, 20, 22, 23, 24 };
+
+/* answer what the snapshot can; 0 if the packet needs the machine */
+static int serve(const char *pkt)
+{
+	static char reply[PACKET_MAX + 1];
+	u8 regs[REG_BYTES];
+	unsigned addr, len, n;
+
+	reply[0] = 0;
+	switch (pkt[0])
+	{
+	case '?':
+		semaWait(&snapLock);
+		strcpy(reply, stopReply);
+		semaSignal(&snapLock);
+		break;
+	case 'g':
+		semaWait(&snapLock);
+		packRegs(regs, &snapshot.regs);
+		semaSignal(&snapLock);
+		toHex(reply, regs, REG_BYTES);
+		break;
+	case 'p':
+		if (sscanf(pkt + 1, "%x", &n) != 1 || n >= NUM_REGS)
+		{
+			strcpy(reply, "E01");
+			break;
+		}
+		semaWait(&snapLock);
+		packRegs(regs, &snapshot.regs);
+		semaSignal(&snapLock);
+		toHex(reply, regs + regOffset[n], regOffset[n+1] - regOffset[n]);
+		break;
+	case 'm':
+		if (sscanf(pkt + 1, "%x,%x", &addr, &len) != 2 || addr >= 4096)
+		{
+			strcpy(reply, "E01");
+			break;
+		}
+		if (len > PACKET_MAX / 2) len = PACKET_MAX / 2;
+		if (addr + len > 4096) len = 4096 - addr;
+		semaWait(&snapLock);
+		toHex(reply, snapshot.mem + addr, len);
+		semaSignal(&snapLock);
+		break;
+	case 'q':
+		if (!strncmp(pkt, "qSupported", 10))
+			sprintf(reply, "PacketSize=%x;qXfer:features:read+;QStartNoAckMode+", PACKET_MAX);
+		else if (!strncmp(pkt, "qXfer:features:read:target.xml:", 31) &&
+		         sscanf(pkt + 31, "%x,%x", &addr, &len) == 2)
+		{
+			unsigned size = strlen(targetXml);
+			if (addr >= size)
+				strcpy(reply, "l");
+			else
+			{
+				if (len > PACKET_MAX - 1) len = PACKET_MAX - 1;
+				if (len > size - addr) len = size - addr;
+				reply[0] = addr + len < size ? 'm' : 'l';
+				memcpy(reply + 1, targetXml + addr, len);
+				reply[len + 1] = 0;
+			}
+		}
+		else if (!strcmp(pkt, "qAttached"))
+			strcpy(reply, "1");
+		else if (!strcmp(pkt, "qSymbol::"))
+			strcpy(reply, "OK");
+		break;
+	case 'Q':
+		if (!strcmp(pkt, "QStartNoAckMode"))
+		{
+			putPacket("OK");
+			noAck = 1;
+			return 1;
+		}
+		break;
+	case 'H':
+	case 'T':
+		strcpy(reply, "OK");
+		break;
+	case 'c': case 'C': case 's': case 'S':
+	case 'Z': case 'z': case 'G': case 'P': case 'M':
+	case 'k': case 'D': case 3:
+		return 0;
+	}
+	putPacket(reply);
+	return 1;
+}
+
+/* hand a packet to the emulation thread and wait until it is dealt with */
+static void post(const char *pkt)
+{
+	if (quit) return;
+	strcpy(mailbox, pkt);
+	semaSignal(&request);
+	semaWait(&done);
+}
+
+/* read one packet; 3 for an interrupt, -1 when the connection drops */
+static int getPacket(char *pkt)
+{
+	static char buf[512];
+	static int pos, fill;
+	int n = 0, state = 0, sum = 0, check = 0;
+
+	for (;;)
+	{
+		char c;
+		if (pos == fill)
+		{
+			if ((fill = recv(conn, buf, sizeof(buf), 0)) <= 0)
+			{
+				pos = fill = 0;
+				return -1;
+			}
+			pos = 0;
+		}
+		c = buf[pos++];
+		switch (state)
+		{
+		case 0:
+			if (c == 3) return 3;
+			if (c == '$') { state = 1; n = sum = 0; }
+			break;
+		case 1:
+			if (c == '#') { state = 2; break; }
+			if (n < PACKET_MAX) pkt[n++] = c;
+			sum += (u8)c;
+			break;
+		case 2:
+			check = hexValue(c) << 4;
+			state = 3;
+			break;
+		case 3:
+			check |= hexValue(c);
+			pkt[n] = 0;
+			if (!noAck)
+				send(conn, check == (sum & 0xff) ? "+" : "-", 1, MSG_NOSIGNAL);
+			if (noAck || check == (sum & 0xff))
+				return n ? 0 : 1;
+			state = 0;
+			break;
+		}
+	}
+}
+
+static int serverThread(void *arg)
+{
+	static char pkt[PACKET_MAX + 1];
+	int one = 1, r;
+	(void)arg;
+
+	while (!quit)
+	{
+		int s = accept(listenSock, NULL, NULL);
+		if (s < 0) continue;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		semaWait(&sendLock);
+		conn = s;
+		semaSignal(&sendLock);
+		noAck = 0;
+		connected = 1;
+		while ((r = getPacket(pkt)) >= 0)
+		{
+			if (r == 3)
+				post("\003");
+			else if (r == 0 && !serve(pkt))
+				post(pkt);
+		}
+		connected = 0;
+		post("d");                  // lost the debugger: detach quietly
+		semaWait(&sendLock);
+		conn = -1;
+		semaSignal(&sendLock);
+		close(s);
+	}
+	return 0;
+}
+
+static void publish(void)
+{
+	const char *watch;
+
+	chip8_save_state(&snapshot);
+	if (interrupted)
+		strcpy(stopReply, "T02");
+	else switch (chip8_stop_reason)
+	{
+	case CHIP8_STOP_READ:
+	case CHIP8_STOP_WRITE:
+		watch = watchFlags[chip8_stop_addr] == (CHIP8_WATCH_READ | CHIP8_WATCH_WRITE) ? "awatch" :
+		        chip8_stop_reason == CHIP8_STOP_READ ? "rwatch" : "watch";
+		sprintf(stopReply, "T05%s:%x;", watch, chip8_stop_addr);
+		break;
+	default:
+		strcpy(stopReply, "T05");
+	}
+}
+
+static int setPoint(const char *pkt)
+{
+	unsigned type, addr, len, a;
+	byte flag;
+
+	if (sscanf(pkt + 1, "%x,%x,%x", &type, &addr, &len) != 3 || addr >= 4096 || type > 4)
+		return 0;
+	if (type < 2)
+	{
+		chip8_set_breakpoint(addr, pkt[0] == 'Z');
+		return 1;
+	}
+	flag = type == 2 ? CHIP8_WATCH_WRITE : type == 3 ? CHIP8_WATCH_READ : CHIP8_WATCH_READ | CHIP8_WATCH_WRITE;
+	for (a = addr; a < addr + len && a < 4096; a++)
+	{
+		if (pkt[0] == 'Z') watchFlags[a] |= flag;
+		else watchFlags[a] &= ~flag;
+		chip8_set_watchpoint(a, 1, watchFlags[a]);
+	}
+	return 1;
+}
+
+/* run a packet on the emulation thread: 1 to resume, -1 killed, 0 otherwise */
+static int handle(const char *pkt)
+{
+	u8 buf[PACKET_MAX / 2];
+	unsigned addr, len, n;
+	const char *p;
+	const char *reply = "OK";
+
+	switch (pkt[0])
+	{
+	case 3:
+		if (chip8_running == 1)
+		{
+			interrupted = 1;
+			chip8_running = 2;
+		}
+		return 0;
+	case 'c': case 'C':
+	case 's': case 'S':
+		if ((p = strchr(pkt, pkt[0] == 'C' || pkt[0] == 'S' ? ';' : pkt[0])) && sscanf(p + 1, "%x", &addr) == 1)
+			chip8_regs.pc = addr & 4095;
+		chip8_set_step(pkt[0] == 's' || pkt[0] == 'S');
+		return 1;
+	case 'Z':
+	case 'z':
+		if (!setPoint(pkt)) reply = "E01";
+		break;
+	case 'G':
+		if (strlen(pkt + 1) == REG_BYTES * 2 && fromHex(buf, pkt + 1, REG_BYTES))
+			unpackRegs(&chip8_regs, buf);
+		else
+			reply = "E01";
+		break;
+	case 'P':
+		if (sscanf(pkt + 1, "%x=", &n) == 1 && n < NUM_REGS && (p = strchr(pkt, '=')) &&
+		    strlen(p + 1) == (size_t)(regOffset[n+1] - regOffset[n]) * 2)
+		{
+			packRegs(buf, &chip8_regs);
+			fromHex(buf + regOffset[n], p + 1, regOffset[n+1] - regOffset[n]);
+			unpackRegs(&chip8_regs, buf);
+		}
+		else
+			reply = "E01";
+		break;
+	case 'M':
+		if (sscanf(pkt + 1, "%x,%x:", &addr, &len) == 2 && (p = strchr(pkt, ':')) &&
+		    len <= sizeof(buf) && addr + len <= 4096 && strlen(p + 1) == len * 2 && fromHex(buf, p + 1, len))
+		{
+#ifdef CHIP8_COW
+			/* forks would not see the write, see chip8_fork */
+			reply = "E01";
+#else
+			memcpy(chip8_mem + addr, buf, len);
+#ifdef CHIP8_HASH
+			chip8_rehash();
+#endif
+#endif
+		}
+		else
+			reply = "E01";
+		break;
+	case 'k':
+		chip8_running = 0;
+		return -1;
+	case 'D':
+	case 'd':
+		chip8_clear_debug();
+		memset(watchFlags, 0, sizeof(watchFlags));
+		if (pkt[0] == 'D') putPacket("OK");
+		resumed = 0;
+		return 1;
+	}
+	semaWait(&snapLock);
+	publish();
+	semaSignal(&snapLock);
+	putPacket(reply);
+	return 0;
+}
+
+int gdbstubOpen(int port)
+{
+	struct sockaddr_in local;
+	int one = 1;
+
+	if ((listenSock = socket(AF_INET, SOCK_STREAM, 0)) < 0) return 0;
+	setsockopt(listenSock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_port = htons(port);
+	local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listenSock, (struct sockaddr*)&local, sizeof(local)) < 0 || listen(listenSock, 1) < 0)
+	{
+		close(listenSock);
+		listenSock = -1;
+		return 0;
+	}
+	buildTargetXml();
+	semaInit(&sendLock, 1);
+	semaInit(&snapLock, 1);
+	semaInit(&request, 0);
+	semaInit(&done, 0);
+	quit = connected = 0;
+	return threadStart(&server, "gdbstub", 0x20, serverThread, NULL);
+}
+
+void gdbstubFrame()
+{
+	/* never wait for the server: if it is reading, skip this frame */
+	if (connected && semaTryWait(&snapLock))
+	{
+		chip8_save_state(&snapshot);
+		semaSignal(&snapLock);
+	}
+	while (semaTryWait(&request))
+	{
+		if (mailbox[0] != 'c' && mailbox[0] != 's' && mailbox[0] != 'C' && mailbox[0] != 'S')
+			handle(mailbox);
+		semaSignal(&done);
+	}
+}
+
+int gdbstubStopped()
+{
+	int r;
+
+	semaWait(&snapLock);
+	publish();
+	semaSignal(&snapLock);
+	if (resumed)
+		putPacket(stopReply);
+	resumed = 0;
+	interrupted = 0;
+
+	do
+	{
+		semaWait(&request);
+		r = handle(mailbox);
+		if (r > 0 && mailbox[0] != 'D' && mailbox[0] != 'd')
+			resumed = 1;
+		semaSignal(&done);
+	} while (!r);
+
+	if (r < 0) return 0;
+	chip8_running = 1;
+	return 1;
+}
+
+void gdbstubClose()
+{
+	if (listenSock < 0) return;
+	if (connected)
+		putPacket(chip8_running == 3 ? "X04" : "W00");
+	quit = 1;
+	shutdown(listenSock, SHUT_RDWR);
+	semaWait(&sendLock);
+	if (conn >= 0) shutdown(conn, SHUT_RDWR);
+	semaSignal(&sendLock);
+	semaSignal(&done);
+	threadJoin(&server);
+	close(listenSock);
+	listenSock = -1;
+	semaDestroy(&sendLock);
+	semaDestroy(&snapLock);
+	semaDestroy(&request);
+	semaDestroy(&done);
+}
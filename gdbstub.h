@@ -0,0 +1,44 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+/* GDB remote serial protocol server for the CHIP8 core, for host builds.
+   A background thread talks to the debugger. Register and memory reads
+   are answered from a snapshot taken once per frame, so a debugger that
+   polls never holds up the machine. Anything that changes the machine or
+   resumes it is handed to the emulation thread, which picks it up in
+   gdbstubFrame or gdbstubStopped.
+
+   Registers, in 'g' packet order: v0-vf (8 bit), i, pc, sp (16 bit),
+   dt, st (8 bit), little endian. Memory writes are refused in a
+   CHIP8_COW build, where the core cannot track writes from outside. */
+
+#define GDBSTUB_PORT 2159
+
+/**
+ * Listen on a local TCP port and start the server thread.
+ *
+ * @return 1 on success, 0 on failure
+ */
+extern int gdbstubOpen(int port);
+
+/**
+ * Call once per frame from chip8_interrupt. Refreshes the snapshot and
+ * applies requests that arrived meanwhile; an interrupt from the debugger
+ * sets chip8_running to 2.
+ */
+extern void gdbstubFrame();
+
+/**
+ * Call when chip8_running is 2, or before the first frame to wait for a
+ * debugger. Reports the stop and serves the debugger until it resumes.
+ *
+ * @return 1 to keep running, 0 if the debugger killed the machine
+ */
+extern int gdbstubStopped();
+
+/**
+ * Report that the machine exited and shut the server down.
+ */
+extern void gdbstubClose();
+
+#endif
@@ -2,18 +2,23 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
-#include <pspkernel.h>
-#include <pspdisplay.h>
-#include <pspgu.h>
+#include <malloc.h>
 
 #include "graphics.h"
-#include "framebuffer.h"
 
 extern u8 msx[];
 
-unsigned int __attribute__((aligned(16))) list[262144];
-static int dispBufferNumber;
-static int initialized = 0;
+static const GraphicsBackend *backend = NULL;
+
+void setGraphicsBackend(const GraphicsBackend *b)
+{
+	backend = b;
+}
+
+const GraphicsBackend* getGraphicsBackend()
+{
+	return backend;
+}
 
 int getNextPower2(int width)
 {
@@ -25,80 +30,47 @@ int getNextPower2(int width)
 	return b;
 }
 
-Color* getVramDrawBuffer()
-{
-	Color* vram = (Color*) g_vram_base;
-	if(dispBufferNumber>0) vram += FRAMEBUFFER_SIZE / sizeof(Color);
-	return vram;
-}
-
-Color* getVramDisplayBuffer()
-{
-	Color* vram = (Color*) g_vram_base;
-	if(dispBufferNumber==0) vram += FRAMEBUFFER_SIZE / sizeof(Color);
-	return vram;
-}
+#ifdef LOWMEM
+/* images are stacked in the pool, each Image right behind its data */
+static u8 __attribute__((aligned(16))) imagePool[IMAGE_POOL_SIZE];
+static size_t imagePoolUsed = 0;
 
-#define BUF_WIDTH (512)
-#define SCR_WIDTH (480)
-#define SCR_HEIGHT (272)
+#define POOL_ALIGN(n) (((n) + 15) & ~15)
 
-void blitImageToScreen(int sx, int sy, int width, int height, Image* source, int dx, int dy)
+static void* poolAlloc(size_t size)
 {
-	if (!initialized) return;
-	Color* vram = getVramDrawBuffer();
-	sceKernelDcacheWritebackInvalidateAll();
-	guStart();
-	sceGuCopyImage(GU_PSM_8888, sx, sy, width, height, source->textureWidth, source->data, dx, dy, PSP_LINE_SIZE, vram);
-	sceGuFinish();
-	sceGuSync(0,0);
+	void *p;
+	size = POOL_ALIGN(size);
+	if (size > IMAGE_POOL_SIZE - imagePoolUsed) return NULL;
+	p = imagePool + imagePoolUsed;
+	imagePoolUsed += size;
+	return p;
 }
-
-void blitAlphaImageToScreen(int sx, int sy, int width, int height, Image* source, int dx, int dy)
-{
-	if (!initialized) return;
-
-	sceKernelDcacheWritebackInvalidateAll();
-	guStart();
-	sceGuTexImage(0, source->textureWidth, source->textureHeight, source->textureWidth, (void*) source->data);
-	float u = 1.0f / ((float)source->textureWidth);
-	float v = 1.0f / ((float)source->textureHeight);
-	sceGuTexScale(u, v);
-	
-	int j = 0;
-	while (j < width) {
-		Vertex* vertices = (Vertex*) sceGuGetMemory(2 * sizeof(Vertex));
-		int sliceWidth = 64;
-		if (j + sliceWidth > width) sliceWidth = width - j;
-		vertices[0].u = sx + j;
-		vertices[0].v = sy;
-		vertices[0].x = dx + j;
-		vertices[0].y = dy;
-		vertices[0].z = 0;
-		vertices[1].u = sx + j + sliceWidth;
-		vertices[1].v = sy + height;
-		vertices[1].x = dx + j + sliceWidth;
-		vertices[1].y = dy + height;
-		vertices[1].z = 0;
-		sceGuDrawArray(GU_SPRITES, GU_TEXTURE_16BIT | GU_VERTEX_16BIT | GU_TRANSFORM_2D, 2, 0, vertices);
-		j += sliceWidth;
-	}
-	
-	sceGuFinish();
-	sceGuSync(0, 0);
-}
-
+#endif
 
 Image* createImage(int width, int height)
 {
+	int textureWidth = getNextPower2(width), textureHeight = getNextPower2(height);
+#ifdef LOWMEM
+	size_t mark = imagePoolUsed;
+	Color* data = (Color*) poolAlloc(textureWidth * textureHeight * sizeof(Color));
+	Image* image = data ? (Image*) poolAlloc(sizeof(Image)) : NULL;
+	if (!image)
+	{
+		imagePoolUsed = mark;
+		return NULL;
+	}
+	image->data = data;
+#else
 	Image* image = (Image*) malloc(sizeof(Image));
 	if (!image) return NULL;
+	image->data = (Color*) memalign(16, textureWidth * textureHeight * sizeof(Color));
+	if (!image->data) return NULL;
+#endif
 	image->imageWidth = width;
 	image->imageHeight = height;
-	image->textureWidth = getNextPower2(width);
-	image->textureHeight = getNextPower2(height);
-	image->data = (Color*) memalign(16, image->textureWidth * image->textureHeight * sizeof(Color));
-	if (!image->data) return NULL;
+	image->textureWidth = textureWidth;
+	image->textureHeight = textureHeight;
 	memset(image->data, 0, image->textureWidth * image->textureHeight * sizeof(Color));
 	return image;
 }
@@ -106,136 +78,104 @@ Image* createImage(int width, int height)
 int freeImage(Image* image)
 {
 	if(image==NULL || image->data==NULL) return 0;
+#ifdef LOWMEM
+	if ((u8*)image + POOL_ALIGN(sizeof(Image)) != imagePool + imagePoolUsed) return 0;
+	imagePoolUsed = (u8*)image->data - imagePool;
+	image->data = NULL;
+#else
 	free(image->data);
 	image->data = NULL;
 	free(image);
+#endif
 	image = NULL;
 	return 1;
 }
 
-void clearScreen(Color color)
+/* for every font row byte, the 8 pixels of that row in a text colour
+   with the unlit ones 0, so a glyph row is stored whole and the screen
+   is never read back; kept for the last two colours used */
+#define TEXT_SPAN_SETS 2
+
+static Color rowSpans[TEXT_SPAN_SETS][256][8];
+static u32 spanColor[TEXT_SPAN_SETS];
+static int spanValid[TEXT_SPAN_SETS] = { 0 };
+static int spanNext = 0;
+
+static const Color* getRowSpans(u32 color)
 {
-	if (!initialized) return;
-	guStart();
-	sceGuClearColor(color);
-	sceGuClearDepth(0);
-	sceGuClear(GU_COLOR_BUFFER_BIT|GU_DEPTH_BUFFER_BIT);
-	sceGuFinish();
-	sceGuSync(0, 0);
+	int set, i, j;
+	for (set = 0; set < TEXT_SPAN_SETS; set++)
+		if (spanValid[set] && spanColor[set] == color)
+			return rowSpans[set][0];
+
+	set = spanNext;
+	spanNext = (spanNext + 1) % TEXT_SPAN_SETS;
+	for (i = 0; i < 256; i++)
+		for (j = 0; j < 8; j++)
+			rowSpans[set][i][j] = (i & (128 >> j)) ? color : 0;
+	spanColor[set] = color;
+	spanValid[set] = 1;
+	return rowSpans[set][0];
 }
 
-void printText(int x, int y, const char *text, u32 color)
+void rasterText(Color *surface, int pitch, int x, int y, const char *text, u32 color)
 {
-	int c, i, j, l, ox=x;
-	u8 *font;
-	Color *vram_ptr;
-	Color *vram;
-	
-	if (!initialized) return;
-
-	for (c = 0; c < (int)strlen(text); c++) {
+	int i, ox = x;
+	const unsigned char *c;
+	const Color *spans = getRowSpans(color);
+
+	for (c = (const unsigned char*)text; *c; c++) {
 		if (x < 0 || y < 0 || y + 8 > SCREEN_HEIGHT) break;
-		char ch = text[c];
-		if(x > SCREEN_WIDTH){
-			x=ox;
-			y+=8;
-		}
-		vram = getVramDrawBuffer() + x + y * PSP_LINE_SIZE;
-		if(ch=='\n'){
-			x=ox;
-			y+=8;
-			if(y > SCREEN_HEIGHT)
-				return;
+		if (*c == '\n') {
+			x = ox;
+			y += 8;
 			continue;
 		}
-		if(ch=='\0')
-			return;
-		font = &msx[ (int)ch * 8];
-		for (i = l = 0; i < 8; i++, l += 8, font++) {
-			vram_ptr  = vram;
-			for (j = 0; j < 8; j++) {
-				if ((*font & (128 >> j))) *vram_ptr = color;
-				vram_ptr++;
-			}
-			vram += PSP_LINE_SIZE;
+		if (x + 8 > SCREEN_WIDTH) {
+			x = ox;
+			y += 8;
+			if (y + 8 > SCREEN_HEIGHT) break;
 		}
+		Color *vram = surface + x + y * pitch;
+		const u8 *rows = &msx[*c * 8];
+		for (i = 0; i < 8; i++, vram += pitch)
+			memcpy(vram, spans + rows[i] * 8, 8 * sizeof(Color));
 		x += 8;
 	}
 }
 
+void clearScreen(Color color)
+{
+	if (backend) backend->clearScreen(color);
+}
+
+void blitImageToScreen(int sx, int sy, int width, int height, Image* source, int dx, int dy)
+{
+	if (backend) backend->blitImageToScreen(sx, sy, width, height, source, dx, dy);
+}
+
+void printText(int x, int y, const char *text, u32 color)
+{
+	if (backend) backend->printText(x, y, text, color);
+}
+
 void printTextf(int x, int y, u32 color, const char *text, ...)
 {
 	va_list ap;
-	char szBuf[(480*272)/8];
+	char szBuf[TEXT_BUFFER_SIZE];
 
 	va_start(ap, text);
-	vsprintf(szBuf, text, ap);
+	vsnprintf(szBuf, sizeof(szBuf), text, ap);
 	va_end(ap);
 	printText(x, y, szBuf, color);
 }
 
 void flipScreen()
 {
-	if (!initialized) return;
-		
-	sceGuSwapBuffers();
-	
-	dispBufferNumber^=1;
-}
-
-#define BUF_WIDTH (512)
-#define SCR_WIDTH (480)
-#define SCR_HEIGHT (272)
-#define PIXEL_SIZE (4) /* change this if you change to another screenmode */
-#define FRAME_SIZE (BUF_WIDTH * SCR_HEIGHT * PIXEL_SIZE)
-#define ZBUF_SIZE (BUF_WIDTH SCR_HEIGHT * 2) /* zbuffer seems to be 16-bit? */
-
-void initGraphics()
-{
-	dispBufferNumber = 1;
-
-	sceGuInit();
-
-	guStart();
-	sceGuDrawBuffer(GU_PSM_8888, (void*)FRAMEBUFFER_SIZE, PSP_LINE_SIZE);
-	sceGuDispBuffer(SCREEN_WIDTH, SCREEN_HEIGHT, (void*)0, PSP_LINE_SIZE);
-	sceGuClear(GU_COLOR_BUFFER_BIT | GU_DEPTH_BUFFER_BIT);
-	sceGuDepthBuffer((void*) (FRAMEBUFFER_SIZE*2), PSP_LINE_SIZE);
-	sceGuOffset(2048 - (SCREEN_WIDTH / 2), 2048 - (SCREEN_HEIGHT / 2));
-	sceGuViewport(2048, 2048, SCREEN_WIDTH, SCREEN_HEIGHT);
-	sceGuDepthRange(0xc350, 0x2710);
-	sceGuScissor(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
-	sceGuEnable(GU_SCISSOR_TEST);
-	sceGuAlphaFunc(GU_GREATER, 0, 0xff);
-	sceGuEnable(GU_ALPHA_TEST);
-	sceGuDepthFunc(GU_GEQUAL);
-	sceGuEnable(GU_DEPTH_TEST);
-	sceGuFrontFace(GU_CW);
-	sceGuShadeModel(GU_SMOOTH);
-	sceGuEnable(GU_CULL_FACE);
-	sceGuEnable(GU_TEXTURE_2D);
-	sceGuEnable(GU_CLIP_PLANES);
-	sceGuTexMode(GU_PSM_8888, 0, 0, 0);
-	sceGuTexFunc(GU_TFX_REPLACE, GU_TCC_RGBA);
-	sceGuTexFilter(GU_NEAREST, GU_NEAREST);
-	sceGuAmbientColor(0xffffffff);
-	sceGuEnable(GU_BLEND);
-	sceGuBlendFunc(GU_ADD, GU_SRC_ALPHA, GU_ONE_MINUS_SRC_ALPHA, 0, 0);
-	sceGuFinish();
-	sceGuSync(0, 0);
-
-	sceDisplayWaitVblankStart();
-	sceGuDisplay(GU_TRUE);
-	
-	initialized = 1;
+	if (backend) backend->flipScreen();
 }
 
 void disableGraphics()
 {
-	initialized = 0;
-}
-
-void guStart()
-{
-	sceGuStart(GU_DIRECT, list);
+	backend = NULL;
 }
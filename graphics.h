@@ -7,6 +7,15 @@
 #define SCREEN_WIDTH 480
 #define SCREEN_HEIGHT 272
 
+#define TEXT_BUFFER_SIZE 512	// longest string printTextf formats
+
+#ifdef LOWMEM
+#define GU_LIST_WORDS 2048		// display list, each GU call here takes a few dozen
+#define IMAGE_POOL_SIZE (256*128*4 + 64)	// static memory behind createImage: the emulator display
+#else
+#define GU_LIST_WORDS 262144
+#endif
+
 #define SIZE_LINE    176		//in pixel
 #define GUARD_LINE   8			//in pixel
 
@@ -49,11 +58,31 @@ typedef struct
 	Color* data;
 } Image;
 
+/**
+ * Operations a display device has to provide. The functions below that
+ * draw to the screen forward to the current backend.
+ */
+typedef struct
+{
+	void (*clearScreen)(Color color);
+	void (*blitImageToScreen)(int sx, int sy, int width, int height, Image* source, int dx, int dy);
+	void (*printText)(int x, int y, const char* text, u32 color);
+	void (*flipScreen)();
+} GraphicsBackend;
+
+extern void setGraphicsBackend(const GraphicsBackend *backend);
+
+extern const GraphicsBackend* getGraphicsBackend();
+
 int getNextPower2(int width);
 
 extern void blitImageToScreen(int sx, int sy, int width, int height, Image* source, int dx, int dy);
 extern void blitAlphaImageToScreen(int sx, int sy, int width, int height, Image* source, int dx, int dy);
 
+/**
+ * In a LOWMEM build images come from a static pool of IMAGE_POOL_SIZE
+ * bytes and only the image created last is given back by freeImage.
+ */
 extern Image* createImage(int width, int height);
 
 int freeImage(Image* image);
@@ -67,10 +96,43 @@ extern void printTextf(int x, int y, u32 color, const char* text, ...);
 extern void flipScreen();
 
 /**
- * Initialize the graphics.
+ * Draw text with the built-in font into any 32-bit surface. Every 8x8
+ * cell is written whole, the unlit pixels as 0, which is how the cleared
+ * screens it is drawn on look anyway.
+ *
+ * @param pitch - line length of the surface in pixels
+ */
+extern void rasterText(Color *surface, int pitch, int x, int y, const char *text, u32 color);
+
+/**
+ * Initialize the graphics and select the GU backend.
  */
 extern void initGraphics();
 
+/**
+ * Select the offscreen backend: a double buffered SCREEN_WIDTH x
+ * SCREEN_HEIGHT surface in ordinary memory, usable without a PSP. It is
+ * only built into host tools (see tools/screentest.c), which link
+ * tools/msxfont.c for the font.
+ *
+ * @return 1 on success, 0 if out of memory
+ */
+extern int initOffscreenGraphics();
+
+extern void freeOffscreenGraphics();
+
+/**
+ * Get the last flipped offscreen frame, PSP_LINE_SIZE pixels per line.
+ */
+extern const Color* getOffscreenFrame();
+
+/**
+ * Write the last flipped offscreen frame as a binary PPM.
+ *
+ * @return 1 on success, 0 on failure
+ */
+extern int dumpOffscreenFrame(const char *szPath);
+
 /**
  * Disable graphics, used for debug text output.
  */
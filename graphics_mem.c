@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "graphics.h"
+
+#define MEM_FRAME_PIXELS (PSP_LINE_SIZE*SCREEN_HEIGHT)
+
+static Color *buffers[2] = { NULL, NULL };
+static int drawIndex = 0;
+
+static void memClearScreen(Color color)
+{
+	Color *p = buffers[drawIndex];
+	for (int i = 0; i < MEM_FRAME_PIXELS; i++)
+		p[i] = color;
+}
+
+static void memBlitImageToScreen(int sx, int sy, int width, int height, Image* source, int dx, int dy)
+{
+	/* clip against the screen the way the GU scissor would */
+	if (dx < 0) { sx -= dx; width += dx; dx = 0; }
+	if (dy < 0) { sy -= dy; height += dy; dy = 0; }
+	if (dx + width > SCREEN_WIDTH) width = SCREEN_WIDTH - dx;
+	if (dy + height > SCREEN_HEIGHT) height = SCREEN_HEIGHT - dy;
+	if (width <= 0 || height <= 0) return;
+
+	const Color *src = source->data + sx + sy * source->textureWidth;
+	Color *dst = buffers[drawIndex] + dx + dy * PSP_LINE_SIZE;
+	for (int y = 0; y < height; y++, src += source->textureWidth, dst += PSP_LINE_SIZE)
+		memcpy(dst, src, width * sizeof(Color));
+}
+
+static void memPrintText(int x, int y, const char *text, u32 color)
+{
+	rasterText(buffers[drawIndex], PSP_LINE_SIZE, x, y, text, color);
+}
+
+static void memFlipScreen()
+{
+	drawIndex ^= 1;
+}
+
+static const GraphicsBackend memBackend =
+{
+	memClearScreen,
+	memBlitImageToScreen,
+	memPrintText,
+	memFlipScreen
+};
+
+int initOffscreenGraphics()
+{
+	for (int i = 0; i < 2; i++)
+	{
+		if (!buffers[i] && !(buffers[i] = (Color*) calloc(MEM_FRAME_PIXELS, sizeof(Color))))
+		{
+			freeOffscreenGraphics();
+			return 0;
+		}
+	}
+	drawIndex = 0;
+	setGraphicsBackend(&memBackend);
+	return 1;
+}
+
+void freeOffscreenGraphics()
+{
+	if (getGraphicsBackend() == &memBackend)
+		disableGraphics();
+	free(buffers[0]);
+	free(buffers[1]);
+	buffers[0] = buffers[1] = NULL;
+}
+
+const Color* getOffscreenFrame()
+{
+	return buffers[drawIndex ^ 1];
+}
+
+int dumpOffscreenFrame(const char *szPath)
+{
+	const Color *p = getOffscreenFrame();
+	u8 line[SCREEN_WIDTH * 3];
+	FILE *file;
+	int ok = 1;
+
+	if (!p || !(file = fopen(szPath, "wb"))) return 0;
+	fprintf(file, "P6\n%d %d\n255\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+	for (int y = 0; y < SCREEN_HEIGHT; y++, p += PSP_LINE_SIZE)
+	{
+		for (int x = 0; x < SCREEN_WIDTH; x++)
+		{
+			line[x * 3] = R(p[x]);
+			line[x * 3 + 1] = G(p[x]);
+			line[x * 3 + 2] = B(p[x]);
+		}
+		ok &= fwrite(line, sizeof(line), 1, file) == 1;
+	}
+	return (fclose(file) == 0) && ok;
+}
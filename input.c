@@ -0,0 +1,91 @@
+#include <string.h>
+
+#include "CHIP8.h"
+#include "input.h"
+
+/* The producer publishes an event by storing head after filling the slot,
+   the consumer frees it by storing tail after reading it. Each index has
+   a single writer; the acquire/release pairs order the slot accesses. */
+#define LOAD(x)     __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+
+void inputInit(InputQueue *queue)
+{
+	memset(queue, 0, sizeof(*queue));
+}
+
+int inputPush(InputQueue *queue, u64 time, int key, int down)
+{
+	u32 head = queue->head;
+	InputEvent *e;
+
+	if (head - LOAD(queue->tail) >= INPUT_QUEUE)
+	{
+		queue->dropped++;
+		return 0;
+	}
+	e = &queue->event[head & (INPUT_QUEUE - 1)];
+	e->time = time;
+	e->key = key & 15;
+	e->down = down != 0;
+	STORE(queue->head, head + 1);
+	return 1;
+}
+
+u16 inputPushMask(InputQueue *queue, u64 time, u16 from, u16 to)
+{
+	u16 changed = from ^ to;
+	int k;
+
+	for (k = 0; changed; k++, changed >>= 1)
+		if ((changed & 1) && inputPush(queue, time, k, (to >> k) & 1))
+			from ^= 1 << k;
+	return from;
+}
+
+const InputEvent* inputPeek(InputQueue *queue)
+{
+	u32 tail = queue->tail;
+
+	if (LOAD(queue->head) == tail) return NULL;
+	return &queue->event[tail & (INPUT_QUEUE - 1)];
+}
+
+void inputPop(InputQueue *queue)
+{
+	STORE(queue->tail, queue->tail + 1);
+}
+
+int inputRunSlice(InputQueue *queue, u64 windowStart, u64 windowEnd)
+{
+	u64 span = windowEnd > windowStart ? windowEnd - windowStart : 1;
+	u64 first = 0, time;
+	int pos = 0, next = 0, taken = 0, budget, at, r;
+	const InputEvent *e;
+
+	for (;;)
+	{
+		budget = 0;
+		if ((e = inputPeek(queue)) && e->time < windowEnd)
+		{
+			/* the first change goes in at once, the others keep their
+			   distance to it */
+			time = e->time > windowStart ? e->time : windowStart;
+			if (!taken++) first = time;
+			at = (int)((time - first) * chip8_iperiod / span);
+			if (at < next) at = next;
+			if (at <= pos)
+			{
+				chip8_key(e->key, e->down);
+				inputPop(queue);
+				next = pos + 1;
+				continue;
+			}
+			budget = at - pos;
+		}
+		r = chip8_run(budget);
+		if (!(r & CHIP8_RUN_BUDGET))
+			return r;
+		pos += budget;
+	}
+}
@@ -0,0 +1,74 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <psptypes.h>
+
+/* Timestamped key changes from an input thread to the emulation thread.
+   The queue has one producer and one consumer and takes no lock: each
+   side only writes its own index. The emulation applies the changes of a
+   frame in the next timeslice, the first one at once and the others as
+   far apart as they came, so a tap shorter than a frame still reaches the
+   machine and presses keep their order within the frame. */
+
+#define INPUT_QUEUE 64              // events, power of 2
+#define INPUT_POLL_NS 1000000       // how often the PSP input thread polls
+
+typedef struct
+{
+	u64 time;       // timerNow() when the change was seen
+	u8 key;         // CHIP8 key 0-15
+	u8 down;
+} InputEvent;
+
+typedef struct
+{
+	u32 head;       // next slot the producer fills
+	u32 tail;       // next slot the consumer takes
+	u32 dropped;    // events the producer found no room for
+	InputEvent event[INPUT_QUEUE];
+} InputQueue;
+
+extern void inputInit(InputQueue *queue);
+
+/**
+ * Producer side.
+ *
+ * @return 1 if the event was queued, 0 if the queue was full
+ */
+extern int inputPush(InputQueue *queue, u64 time, int key, int down);
+
+/**
+ * Producer side: queue a change for every key that differs between two
+ * masks. Changes that do not fit stay out of the result, so passing it
+ * back as the next from retries them instead of losing a release.
+ *
+ * @return the mask as far as it was queued
+ */
+extern u16 inputPushMask(InputQueue *queue, u64 time, u16 from, u16 to);
+
+/**
+ * Consumer side.
+ *
+ * @return the oldest event, or NULL if the queue is empty
+ */
+extern const InputEvent* inputPeek(InputQueue *queue);
+
+extern void inputPop(InputQueue *queue);
+
+/**
+ * Run one timeslice with chip8_run, from its start and with
+ * chip8_run_mask 0, pressing and releasing keys as queued. The slice
+ * stands for the time from windowStart to windowEnd, which has already
+ * passed: the first change from it is applied before the first opcode, as
+ * a poll at windowEnd would, and every later one (time - first) *
+ * chip8_iperiod / (windowEnd - windowStart) opcodes after it, but at least
+ * one opcode after the change before it, so every key state is seen by the
+ * machine. Changes older than the window count as made at its start,
+ * changes from windowEnd on wait for the next slice.
+ *
+ * @return the reasons of the last chip8_run, CHIP8_RUN_FRAME once the
+ * slice is done
+ */
+extern int inputRunSlice(InputQueue *queue, u64 windowStart, u64 windowEnd);
+
+#endif
@@ -0,0 +1,502 @@
+#include <stdlib.h>
+#include <string.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "lanes.h"
+
+static void storeRegs(Lanes *lanes, int l, const struct chip8_regs_struct *regs)
+{
+	int r;
+	for (r = 0; r < 16; r++)
+		lanes->v[r][l] = regs->alg[r];
+	lanes->i[l] = regs->i;
+	lanes->pc[l] = regs->pc;
+	lanes->sp[l] = regs->sp;
+	lanes->delay[l] = regs->delay;
+	lanes->sound[l] = regs->sound;
+}
+
+static void loadRegs(const Lanes *lanes, int l, struct chip8_regs_struct *regs)
+{
+	int r;
+	for (r = 0; r < 16; r++)
+		regs->alg[r] = (byte)lanes->v[r][l];
+	regs->i = lanes->i[l];
+	regs->pc = lanes->pc[l];
+	regs->sp = lanes->sp[l];
+	regs->delay = (byte)lanes->delay[l];
+	regs->sound = (byte)lanes->sound[l];
+}
+
+int lanesInit(Lanes *lanes, int count)
+{
+	int l;
+
+	if (count < 1 || count > LANES_MAX) return 0;
+	memset(lanes, 0, sizeof(*lanes));
+	if (!(lanes->state = (struct chip8_state*) malloc(count * sizeof(struct chip8_state)))) return 0;
+	chip8_save_state(&lanes->state[0]);
+	for (l = 0; l < count; l++)
+	{
+		if (l) lanes->state[l] = lanes->state[0];
+		storeRegs(lanes, l, &lanes->state[l].regs);
+	}
+	/* unused lanes sit at a pc no lane will ever reach first */
+	for (; l < LANES_MAX; l++)
+		lanes->pc[l] = 0xffff;
+	lanes->count = count;
+	return 1;
+}
+
+void lanesFree(Lanes *lanes)
+{
+	free(lanes->state);
+	lanes->state = NULL;
+	lanes->count = 0;
+}
+
+void lanesSetKeys(Lanes *lanes, int lane, u16 keys)
+{
+	lanes->state[lane].keys = keys;
+}
+
+void lanesGetState(const Lanes *lanes, int lane, struct chip8_state *state)
+{
+	*state = lanes->state[lane];
+	loadRegs(lanes, lane, &state->regs);
+}
+
+static inline word fetch(const Lanes *lanes, int l)
+{
+	const byte *mem = lanes->state[l].mem;
+	word pc = lanes->pc[l];
+	return (mem[pc & 4095] << 8) | mem[(pc + 1) & 4095];
+}
+
+/* the opcodes that only touch registers, timers and pc */
+static inline int vectorizable(word op)
+{
+	switch (op >> 12)
+	{
+	case 0x1: case 0x3: case 0x4: case 0x5: case 0x6: case 0x7:
+	case 0x8: case 0x9: case 0xa: case 0xb:
+		return 1;
+	case 0xf:
+		switch (op & 0xff)
+		{
+		case 0x07: case 0x15: case 0x1e: case 0x29:
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* as chip8_update_key_pressed */
+static void updateKeyPressed(struct chip8_state *s)
+{
+	byte i, pressed = 0;
+	for (i = 0; i < 16; i++)
+		if (s->keys & (1 << i))
+			pressed = i + 1;
+	s->key_pressed = (pressed && pressed != s->key_pressed) ? pressed : 0;
+}
+
+static inline void markDirty(Lanes *lanes, int l, u16 addr, int len)
+{
+	lanes->dirty[(addr & 4095) >> 6] |= 1u << l;
+	lanes->dirty[((addr + len - 1) & 4095) >> 6] |= 1u << l;
+}
+
+/* the other opcodes on one lane, as the core runs them. Returns 0 for
+   the ones left to the core */
+static int scalarStep(Lanes *lanes, int l, word op)
+{
+	struct chip8_state *s = &lanes->state[l];
+	byte *mem = s->mem;
+	int x = (op >> 8) & 15, k;
+	u16 pc = lanes->pc[l] + 2, sp, i = lanes->i[l], vx = lanes->v[x][l];
+
+	switch (op >> 12)
+	{
+	case 0x0:
+		if (op == 0x00e0)
+			memset(s->display, 0, sizeof(s->display));
+		else if (op == 0x00ee)
+		{
+			sp = lanes->sp[l];
+			pc = mem[sp & 4095] << 8;
+			pc += mem[(sp + 1) & 4095];
+			lanes->sp[l] = sp + 2;
+		}
+		else
+			return 0;
+		break;
+	case 0x2:
+		sp = lanes->sp[l] - 2;
+		mem[(sp + 1) & 4095] = pc & 0xff;
+		mem[sp & 4095] = pc >> 8;
+		markDirty(lanes, l, sp, 2);
+		lanes->sp[l] = sp;
+		pc = op & 0xfff;
+		break;
+	case 0xc:
+		s->rng = s->rng * 1103515245 + 12345;
+		lanes->v[x][l] = (byte)(s->rng >> 16) & (op & 0xff);
+		break;
+#ifndef CHIP8_SUPER
+	case 0xd:
+	{
+		byte *q, y, x2, bits, collision = 1;
+		int n;
+
+		x2 = vx & 63;
+		y = lanes->v[(op >> 4) & 15][l] & 31;
+		n = op & 15;
+		if (n + y > 32)
+			n = 32 - y;
+		for (q = s->display + y * CHIP8_WIDTH; n; --n, q += CHIP8_WIDTH, i++)
+			for (bits = mem[i & 4095], k = x2; bits; bits <<= 1, k = (k + 1) & (CHIP8_WIDTH - 1))
+				if (bits & 0x80)
+					collision &= (q[k] ^= 0xff);
+		lanes->v[15][l] = collision ^ 1;
+		break;
+	}
+#endif
+	case 0xe:
+		if ((op & 0xff) == 0x9e)
+		{
+			if (s->keys & (1 << (vx & 15))) pc += 2;
+		}
+		else if ((op & 0xff) == 0xa1)
+		{
+			if (!(s->keys & (1 << (vx & 15)))) pc += 2;
+		}
+		break;
+	case 0xf:
+		switch (op & 0xff)
+		{
+		case 0x0a:
+			if (s->key_pressed)
+				lanes->v[x][l] = s->key_pressed - 1;
+			else
+				pc -= 2;
+			break;
+		case 0x18:
+			lanes->sound[l] = vx;
+			if (vx)
+				chip8_sound_on();
+			break;
+		case 0x33:
+			mem[i & 4095] = vx / 100;
+			mem[(i + 1) & 4095] = vx / 10 % 10;
+			mem[(i + 2) & 4095] = vx % 10;
+			markDirty(lanes, l, i, 3);
+			break;
+		case 0x55:
+			for (k = 0; k <= x; k++)
+				mem[(i + k) & 4095] = (byte)lanes->v[k][l];
+			markDirty(lanes, l, i, x + 1);
+			if (chip8_quirks & CHIP8_QUIRK_LOADSTORE)
+				lanes->i[l] = i + x + 1;
+			break;
+		case 0x65:
+			for (k = 0; k <= x; k++)
+				lanes->v[k][l] = mem[(i + k) & 4095];
+			if (chip8_quirks & CHIP8_QUIRK_LOADSTORE)
+				lanes->i[l] = i + x + 1;
+			break;
+		default:
+			return 0;
+		}
+		break;
+	default:
+		return 0;
+	}
+	lanes->pc[l] = pc;
+	lanes->left[l]--;
+	return 1;
+}
+
+/* hand the rest of a lane's timeslice to the core */
+static void peel(Lanes *lanes, int l)
+{
+	struct chip8_state *s = &lanes->state[l];
+	int k;
+
+	loadRegs(lanes, l, &s->regs);
+	s->key_pressed = lanes->keyPressed[l];  // chip8_frame updates it again
+	chip8_load_state(s);
+	chip8_iperiod = lanes->left[l];
+	chip8_frame();
+	chip8_save_state(s);
+	storeRegs(lanes, l, &s->regs);
+	for (k = 0; k < 64; k++)               // it may have written anywhere
+		lanes->dirty[k] |= 1u << l;
+	lanes->scalarOps += lanes->left[l];
+	lanes->left[l] = 0;
+	lanes->peels++;
+}
+
+#ifdef __AVX2__
+
+#define LOAD(p) _mm256_load_si256((const __m256i*)(p))
+#define STORE(p,x) _mm256_store_si256((__m256i*)(p), (x))
+#define SET(n) _mm256_set1_epi16((short)(n))
+
+static inline void blendStore(u16 *p, __m256i x, __m256i mask)
+{
+	STORE(p, _mm256_blendv_epi8(LOAD(p), x, mask));
+}
+
+/* a >= b, as all ones or zero */
+static inline __m256i greaterEqual(__m256i a, __m256i b)
+{
+	return _mm256_cmpeq_epi16(_mm256_max_epu16(a, b), a);
+}
+
+static void execute(Lanes *lanes, word op, u32 bits)
+{
+	const __m256i sel = _mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, -32768);
+	__m256i mask = _mm256_cmpeq_epi16(_mm256_and_si256(SET(bits), sel), sel);
+	__m256i ff = SET(0xff), one = SET(1), two = SET(2);
+	int x = (op >> 8) & 15, y = (op >> 4) & 15, nn = op & 0xff, nnn = op & 0xfff;
+	__m256i vx = LOAD(lanes->v[x]), vy = LOAD(lanes->v[y]);
+	__m256i pc = LOAD(lanes->pc), next = _mm256_add_epi16(pc, two);
+	__m256i rx, rf, src;
+
+	switch (op >> 12)
+	{
+	case 0x1:
+		next = SET(nnn);
+		break;
+	case 0x3:
+		next = _mm256_add_epi16(next, _mm256_and_si256(_mm256_cmpeq_epi16(vx, SET(nn)), two));
+		break;
+	case 0x4:
+		next = _mm256_add_epi16(next, _mm256_andnot_si256(_mm256_cmpeq_epi16(vx, SET(nn)), two));
+		break;
+	case 0x5:
+		next = _mm256_add_epi16(next, _mm256_and_si256(_mm256_cmpeq_epi16(vx, vy), two));
+		break;
+	case 0x9:
+		next = _mm256_add_epi16(next, _mm256_andnot_si256(_mm256_cmpeq_epi16(vx, vy), two));
+		break;
+	case 0x6:
+		blendStore(lanes->v[x], SET(nn), mask);
+		break;
+	case 0x7:
+		blendStore(lanes->v[x], _mm256_and_si256(_mm256_add_epi16(vx, SET(nn)), ff), mask);
+		break;
+	case 0xa:
+		blendStore(lanes->i, SET(nnn), mask);
+		break;
+	case 0xb:
+		next = _mm256_add_epi16(SET(nnn), (chip8_quirks & CHIP8_QUIRK_JUMP) ? vx : LOAD(lanes->v[0]));
+		break;
+	case 0xf:
+		switch (op & 0xff)
+		{
+		case 0x07: blendStore(lanes->v[x], LOAD(lanes->delay), mask); break;
+		case 0x15: blendStore(lanes->delay, vx, mask); break;
+		case 0x1e: blendStore(lanes->i, _mm256_add_epi16(LOAD(lanes->i), vx), mask); break;
+		case 0x29: blendStore(lanes->i, _mm256_mullo_epi16(_mm256_and_si256(vx, SET(15)), SET(5)), mask); break;
+		}
+		break;
+	case 0x8:
+		src = (chip8_quirks & CHIP8_QUIRK_SHIFT) ? vy : vx;
+		switch (op & 15)
+		{
+		case 0x0: blendStore(lanes->v[x], vy, mask); break;
+		case 0x1: blendStore(lanes->v[x], _mm256_or_si256(vx, vy), mask); break;
+		case 0x2: blendStore(lanes->v[x], _mm256_and_si256(vx, vy), mask); break;
+		case 0x3: blendStore(lanes->v[x], _mm256_xor_si256(vx, vy), mask); break;
+		/* the result, then VF */
+		case 0x4:
+			rx = _mm256_add_epi16(vx, vy);
+			blendStore(lanes->v[x], _mm256_and_si256(rx, ff), mask);
+			blendStore(lanes->v[15], _mm256_srli_epi16(rx, 8), mask);
+			break;
+		case 0x5:
+			blendStore(lanes->v[x], _mm256_and_si256(_mm256_sub_epi16(vx, vy), ff), mask);
+			blendStore(lanes->v[15], _mm256_and_si256(greaterEqual(vx, vy), one), mask);
+			break;
+		case 0x7:
+			blendStore(lanes->v[x], _mm256_and_si256(_mm256_sub_epi16(vy, vx), ff), mask);
+			blendStore(lanes->v[15], _mm256_and_si256(greaterEqual(vy, vx), one), mask);
+			break;
+		/* VF, then the result */
+		case 0x6:
+			rf = _mm256_and_si256(src, one);
+			rx = _mm256_srli_epi16(src, 1);
+			blendStore(lanes->v[15], rf, mask);
+			blendStore(lanes->v[x], rx, mask);
+			break;
+		case 0xe:
+			rf = _mm256_srli_epi16(src, 7);
+			rx = _mm256_and_si256(_mm256_slli_epi16(src, 1), ff);
+			blendStore(lanes->v[15], rf, mask);
+			blendStore(lanes->v[x], rx, mask);
+			break;
+		}
+		break;
+	}
+	STORE(lanes->pc, _mm256_blendv_epi8(pc, next, mask));
+	STORE(lanes->left, _mm256_sub_epi16(LOAD(lanes->left), _mm256_and_si256(mask, one)));
+}
+
+/* lowest pc among lanes with opcodes left, and the lanes at it */
+static int nextPc(const Lanes *lanes, u32 *bits)
+{
+	__m256i left = LOAD(lanes->left);
+	__m256i idle = _mm256_cmpeq_epi16(left, _mm256_setzero_si256());
+	__m256i pc = _mm256_or_si256(LOAD(lanes->pc), idle);
+	__m128i lo = _mm_min_epu16(_mm256_castsi256_si128(pc), _mm256_extracti128_si256(pc, 1));
+	__m128i best = _mm_minpos_epu16(lo);
+	u32 mm;
+	int min = _mm_extract_epi16(best, 0);
+
+	if (min == 0xffff && _mm256_testz_si256(left, left)) return -1;
+	/* narrow to bytes, which packs lanes 0-7 into bits 0-7 and lanes 8-15
+	   into bits 16-23 of the byte mask */
+	mm = _mm256_movemask_epi8(_mm256_packs_epi16(_mm256_andnot_si256(idle, _mm256_cmpeq_epi16(pc, SET(min))),
+	                                             _mm256_setzero_si256()));
+	*bits = (mm & 0xff) | ((mm >> 8) & 0xff00);
+	return min;
+}
+
+#else
+
+static void execute(Lanes *lanes, word op, u32 bits)
+{
+	int x = (op >> 8) & 15, y = (op >> 4) & 15, nn = op & 0xff, nnn = op & 0xfff, l;
+
+	for (l = 0; l < lanes->count; l++)
+	{
+		u16 vx, vy, src, next;
+		if (!(bits & (1u << l))) continue;
+		vx = lanes->v[x][l];
+		vy = lanes->v[y][l];
+		src = (chip8_quirks & CHIP8_QUIRK_SHIFT) ? vy : vx;
+		next = lanes->pc[l] + 2;
+		switch (op >> 12)
+		{
+		case 0x1: next = nnn; break;
+		case 0x3: if (vx == nn) next += 2; break;
+		case 0x4: if (vx != nn) next += 2; break;
+		case 0x5: if (vx == vy) next += 2; break;
+		case 0x9: if (vx != vy) next += 2; break;
+		case 0x6: lanes->v[x][l] = nn; break;
+		case 0x7: lanes->v[x][l] = (vx + nn) & 0xff; break;
+		case 0xa: lanes->i[l] = nnn; break;
+		case 0xb: next = nnn + ((chip8_quirks & CHIP8_QUIRK_JUMP) ? vx : lanes->v[0][l]); break;
+		case 0xf:
+			switch (op & 0xff)
+			{
+			case 0x07: lanes->v[x][l] = lanes->delay[l]; break;
+			case 0x15: lanes->delay[l] = vx; break;
+			case 0x1e: lanes->i[l] += vx; break;
+			case 0x29: lanes->i[l] = (vx & 15) * 5; break;
+			}
+			break;
+		case 0x8:
+			switch (op & 15)
+			{
+			case 0x0: lanes->v[x][l] = vy; break;
+			case 0x1: lanes->v[x][l] = vx | vy; break;
+			case 0x2: lanes->v[x][l] = vx & vy; break;
+			case 0x3: lanes->v[x][l] = vx ^ vy; break;
+			case 0x4: lanes->v[x][l] = (vx + vy) & 0xff; lanes->v[15][l] = (vx + vy) >> 8; break;
+			case 0x5: lanes->v[x][l] = (vx - vy) & 0xff; lanes->v[15][l] = vx >= vy; break;
+			case 0x7: lanes->v[x][l] = (vy - vx) & 0xff; lanes->v[15][l] = vy >= vx; break;
+			case 0x6: lanes->v[15][l] = src & 1; lanes->v[x][l] = src >> 1; break;
+			case 0xe: lanes->v[15][l] = src >> 7; lanes->v[x][l] = (src << 1) & 0xff; break;
+			}
+			break;
+		}
+		lanes->pc[l] = next;
+		lanes->left[l]--;
+	}
+}
+
+static int nextPc(const Lanes *lanes, u32 *bits)
+{
+	int l, min = -1;
+
+	for (l = 0; l < lanes->count; l++)
+		if (lanes->left[l] && (min < 0 || lanes->pc[l] < min))
+			min = lanes->pc[l];
+	for (*bits = 0, l = 0; l < lanes->count; l++)
+		if (lanes->left[l] && lanes->pc[l] == min)
+			*bits |= 1u << l;
+	return min;
+}
+
+#endif
+
+void lanesFrame(Lanes *lanes)
+{
+	byte iperiod = chip8_iperiod;
+	u32 bits, peeled = 0, same, b;
+	int l, pc;
+
+	for (l = 0; l < lanes->count; l++)
+	{
+		lanes->keyPressed[l] = lanes->state[l].key_pressed;
+		updateKeyPressed(&lanes->state[l]);
+		lanes->left[l] = iperiod;
+	}
+
+	while ((pc = nextPc(lanes, &bits)) >= 0)
+	{
+		int leader = __builtin_ctz(bits);
+		word op = fetch(lanes, leader);
+		u32 dirty = lanes->dirty[(pc & 4095) >> 6] | lanes->dirty[((pc + 1) & 4095) >> 6];
+
+		/* lanes that never wrote near pc still hold the code all lanes
+		   started with. Others are compared with the leader, and those
+		   whose code was changed wait for a later step */
+		same = bits;
+		if (dirty & bits)
+		{
+			b = (dirty & (1u << leader)) ? bits : bits & dirty;
+			for (same = bits & ~b; b; b &= b - 1)
+				if (fetch(lanes, __builtin_ctz(b)) == op)
+					same |= b & -b;
+		}
+
+		if (vectorizable(op))
+		{
+			execute(lanes, op, same);
+			lanes->vectorOps += __builtin_popcount(same);
+			lanes->steps++;
+		}
+		else
+		{
+			for (b = same; b; b &= b - 1)
+			{
+				l = __builtin_ctz(b);
+				if (scalarStep(lanes, l, op))
+					lanes->scalarOps++;
+				else
+				{
+					peel(lanes, l);
+					peeled |= 1u << l;
+				}
+			}
+		}
+	}
+	chip8_iperiod = iperiod;
+
+	/* the core already ran the timers of peeled lanes */
+	for (l = 0; l < lanes->count; l++)
+	{
+		if (peeled & (1u << l)) continue;
+		if (lanes->delay[l])
+			lanes->delay[l]--;
+		if (lanes->sound[l])
+			if (--lanes->sound[l] == 0)
+				chip8_sound_off();
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef LANES_H
+#define LANES_H
+
+#include <psptypes.h>
+#include "CHIP8.h"
+
+/* Runs up to LANES_MAX machines in lockstep. The registers of all lanes
+   are kept as 16 bit struct-of-arrays rows so one AVX2 register holds a
+   row. Every step executes the opcode at the lowest pc among the lanes
+   that still have opcodes left in the timeslice, for all lanes at that pc
+   with that opcode. ALU, skip, jump, Annn and the timer and I register
+   Fx opcodes run on the vector unit, the rest lane by lane on each lane's
+   own memory. Opcodes only a SUPER machine uses peel the lane out to the
+   CHIP8.c core for the rest of its timeslice. */
+
+#define LANES_MAX 16
+
+typedef struct
+{
+	int count;
+	u16 v[16][LANES_MAX] __attribute__((aligned(32)));
+	u16 i[LANES_MAX] __attribute__((aligned(32)));
+	u16 pc[LANES_MAX] __attribute__((aligned(32)));
+	u16 sp[LANES_MAX] __attribute__((aligned(32)));
+	u16 delay[LANES_MAX] __attribute__((aligned(32)));
+	u16 sound[LANES_MAX] __attribute__((aligned(32)));
+	u16 left[LANES_MAX] __attribute__((aligned(32)));     // opcodes left in the slice
+	struct chip8_state *state;  // memory, display, keys and the rest, per lane
+	u8 keyPressed[LANES_MAX];   // key_pressed before this slice's update
+	u16 dirty[64];              // lanes that wrote to each 64 byte block
+	u64 vectorOps;              // lane opcodes run on the vector unit
+	u64 scalarOps;              // lane opcodes run by the core
+	u64 steps, peels;
+} Lanes;
+
+/**
+ * Start count lanes, each a copy of the core's current state.
+ *
+ * @return 1 on success, 0 on failure
+ */
+extern int lanesInit(Lanes *lanes, int count);
+
+extern void lanesFree(Lanes *lanes);
+
+/**
+ * @param keys - bit n for CHIP8 key n
+ */
+extern void lanesSetKeys(Lanes *lanes, int lane, u16 keys);
+
+/**
+ * Run one timeslice (chip8_iperiod opcodes and the timers) on every lane,
+ * with the same result as chip8_frame on each machine. A lane peeled out
+ * to the core is run in the core's own machine, overwriting its state.
+ */
+extern void lanesFrame(Lanes *lanes);
+
+/**
+ * Copy out the complete state of one lane.
+ */
+extern void lanesGetState(const Lanes *lanes, int lane, struct chip8_state *state);
+
+#endif
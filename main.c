@@ -7,6 +7,9 @@
 #include "callbacks.h"
 #include "graphics.h"
 #include "filer.h"
+#include "romdb.h"
+#include "romcache.h"
+#include "footprint.h"
 
 #include "psp.h"
 #include "CHIP8.h"
@@ -32,6 +35,12 @@ int main(int argc, char **argv)
   char *p = strrchr(Ebootpath, '/');
   *p = 0;
   
+  char Dbpath[256+16];
+  sprintf(Dbpath, "%s/romdb.bin", Ebootpath);
+  romdbOpen(Dbpath);
+  romcacheInit();
+  footprintStartup();
+  
   FileBrowser(Ebootpath);
   
   sceKernelSleepThread();
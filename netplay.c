@@ -0,0 +1,236 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "CHIP8.h"
+#include "netplay.h"
+#include "timer.h"
+
+#define MAGIC 0x4e503843            // "C8PN"
+#define MAX_INPUTS 64
+#define DELAY_QUEUE 256
+#define SLOT(f) ((f) & (NETPLAY_HISTORY - 1))
+
+typedef struct
+{
+	u32 magic;
+	u32 ack;            // frames of the receiver's input we have
+	u32 first;          // frame of inputs[0]
+	u32 count;
+	u16 inputs[MAX_INPUTS];
+} Packet;
+
+typedef struct
+{
+	u64 due;
+	int size;
+	Packet packet;
+} Delayed;
+
+static int sock = -1;
+static struct sockaddr_in peer;
+
+static u16 localInput[NETPLAY_HISTORY];
+static u16 remoteInput[NETPLAY_HISTORY];    // real or predicted
+static struct chip8_state snapshots[NETPLAY_HISTORY];
+
+static u32 frame;           // next frame to run
+static u32 confirmed;       // remote input known for frames < confirmed
+static u32 peerAck;         // peer has our input for frames < peerAck
+static u32 rollbackFrom;    // earliest mispredicted frame, or frame if none
+static u16 lastRemote;
+
+static int latency, loss;
+static Delayed delayed[DELAY_QUEUE];
+static int numDelayed;
+static NetplayStats stats;
+
+int netplayOpen(int localPort, const char *szPeer, int peerPort, u32 seed)
+{
+	struct sockaddr_in local;
+	struct hostent *host;
+
+	if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0) return 0;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_port = htons(localPort);
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(sock, (struct sockaddr*)&local, sizeof(local)) < 0 || !(host = gethostbyname(szPeer)))
+	{
+		netplayClose();
+		return 0;
+	}
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+	memset(&peer, 0, sizeof(peer));
+	peer.sin_family = AF_INET;
+	peer.sin_port = htons(peerPort);
+	memcpy(&peer.sin_addr, host->h_addr, sizeof(peer.sin_addr));
+
+	frame = confirmed = peerAck = rollbackFrom = 0;
+	lastRemote = 0;
+	numDelayed = 0;
+	memset(&stats, 0, sizeof(stats));
+	memset(localInput, 0, sizeof(localInput));
+	memset(remoteInput, 0, sizeof(remoteInput));
+	chip8_rng = seed;
+	return 1;
+}
+
+void netplaySetConditions(int latencyMs, int lossPercent)
+{
+	latency = latencyMs;
+	loss = lossPercent;
+}
+
+static void sendNow(const Packet *p, int size)
+{
+	sendto(sock, p, size, 0, (struct sockaddr*)&peer, sizeof(peer));
+}
+
+/* send through the simulated link */
+static void sendPacket(const Packet *p, int size)
+{
+	stats.sent++;
+	if (loss && rand() % 100 < loss)
+	{
+		stats.dropped++;
+		return;
+	}
+	if (!latency || numDelayed == DELAY_QUEUE)
+	{
+		sendNow(p, size);
+		return;
+	}
+	delayed[numDelayed].due = timerNow() + (u64)latency * 1000000;
+	delayed[numDelayed].size = size;
+	delayed[numDelayed].packet = *p;
+	numDelayed++;
+}
+
+static void flushDelayed(void)
+{
+	u64 now = timerNow();
+	int i = 0, k = 0;
+	for (; i < numDelayed; i++)
+	{
+		if (delayed[i].due <= now) sendNow(&delayed[i].packet, delayed[i].size);
+		else delayed[k++] = delayed[i];
+	}
+	numDelayed = k;
+}
+
+static void receive(void)
+{
+	Packet p;
+	int n;
+
+	while ((n = recv(sock, &p, sizeof(p), 0)) > 0)
+	{
+		u32 f;
+		if (n < (int)offsetof(Packet, inputs) || p.magic != MAGIC || p.count > MAX_INPUTS ||
+		    n < (int)(offsetof(Packet, inputs) + p.count * sizeof(u16)))
+			continue;
+		stats.received++;
+		if (p.ack > peerAck) peerAck = p.ack;
+
+		/* take inputs that continue what we have; older ones are known,
+		   and we cannot keep ones beyond the history */
+		for (f = confirmed; f >= p.first && f < p.first + p.count && f < frame + NETPLAY_HISTORY - NETPLAY_MAX_ROLLBACK; f++)
+		{
+			u16 in = p.inputs[f - p.first];
+			if (f < frame && remoteInput[SLOT(f)] != in && f < rollbackFrom)
+				rollbackFrom = f;
+			remoteInput[SLOT(f)] = in;
+			lastRemote = in;
+			confirmed = f + 1;
+		}
+	}
+}
+
+static void runFrame(u32 f)
+{
+	chip8_keys = localInput[SLOT(f)] | remoteInput[SLOT(f)];
+	chip8_save_state(&snapshots[SLOT(f)]);
+	chip8_frame();
+}
+
+static int update(int advance, u16 keys)
+{
+	Packet p;
+	u32 f;
+	int ran = 0;
+
+	flushDelayed();
+	receive();
+
+	if (rollbackFrom < frame)
+	{
+		u32 depth = frame - rollbackFrom;
+		chip8_load_state(&snapshots[SLOT(rollbackFrom)]);
+		for (f = rollbackFrom; f < frame; f++)
+		{
+			/* frames past what we know keep predicting the latest input */
+			if (f >= confirmed) remoteInput[SLOT(f)] = lastRemote;
+			runFrame(f);
+		}
+		stats.rollbacks++;
+		stats.resimulated += depth;
+		if (depth > stats.maxRollback) stats.maxRollback = depth;
+	}
+
+	if (!advance)
+		;
+	else if ((int)(frame - confirmed) < NETPLAY_MAX_ROLLBACK)
+	{
+		localInput[SLOT(frame)] = keys;
+		if (frame >= confirmed) remoteInput[SLOT(frame)] = lastRemote;
+		runFrame(frame);
+		frame++;
+		ran = 1;
+	}
+	else
+		stats.stalls++;
+	rollbackFrom = frame;
+
+	/* resend everything the peer has not acknowledged */
+	p.magic = MAGIC;
+	p.ack = confirmed;
+	p.first = peerAck;
+	if (frame - p.first > MAX_INPUTS) p.first = frame - MAX_INPUTS;
+	if (frame - p.first > NETPLAY_HISTORY) p.first = frame - NETPLAY_HISTORY;
+	p.count = frame - p.first;
+	for (f = 0; f < p.count; f++)
+		p.inputs[f] = localInput[SLOT(p.first + f)];
+	sendPacket(&p, offsetof(Packet, inputs) + p.count * sizeof(u16));
+
+	stats.frame = frame;
+	stats.confirmed = confirmed;
+	stats.acked = peerAck;
+	return ran;
+}
+
+int netplayFrame(u16 keys)
+{
+	return update(1, keys);
+}
+
+void netplayPoll()
+{
+	update(0, 0);
+}
+
+const NetplayStats* netplayStats()
+{
+	return &stats;
+}
+
+void netplayClose()
+{
+	if (sock >= 0) close(sock);
+	sock = -1;
+}
@@ -0,0 +1,74 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include <psptypes.h>
+
+/* Two-player rollback netplay over UDP. Every frame each side sends its
+   key mask; until the other side's input for a frame arrives it is
+   predicted to be unchanged. When a prediction turns out wrong the
+   machine is restored from the snapshot of that frame and the frames
+   since are run again with the real input.
+
+   Host builds only, over BSD sockets; tools/netpeer plays it over
+   loopback. It is not in the PSP build and the front end has no netplay
+   mode. Playing it on a PSP still needs:
+   - the net modules loaded (sceUtilityLoadNetModule) and sceNetInit,
+     sceNetInetInit and sceNetApctlInit called;
+   - a link: an access point joined through the netconf utility dialog,
+     or an ad hoc link over sceNetAdhocPdp* instead of UDP sockets;
+   - a non-blocking socket set up with setsockopt SO_NONBLOCK instead of
+     fcntl, and the peer address resolved with sceNetResolver or given as
+     a number instead of gethostbyname;
+   - a front-end choice of host or peer and address, and an Emulate loop
+     that runs frames through netplayFrame instead of inputRunSlice. */
+
+#define NETPLAY_MAX_ROLLBACK 12     // frames we may run ahead of the peer
+#define NETPLAY_HISTORY 32          // must be > NETPLAY_MAX_ROLLBACK, power of 2
+#define NETPLAY_PORT 6502
+
+typedef struct
+{
+	u32 frame;          // frames completed
+	u32 confirmed;      // frames for which we have the peer's input
+	u32 acked;          // frames for which the peer has our input
+	u32 rollbacks;
+	u32 resimulated;    // frames run again after a misprediction
+	u32 maxRollback;    // longest rollback, in frames
+	u32 stalls;         // netplayFrame calls that had to wait for the peer
+	u32 sent, received, dropped;
+} NetplayStats;
+
+/**
+ * Bind the local UDP port and aim at the peer. The machine must already
+ * be reset with the ROM loaded; both sides must use the same seed.
+ *
+ * @return 1 on success, 0 on failure
+ */
+extern int netplayOpen(int localPort, const char *szPeer, int peerPort, u32 seed);
+
+/**
+ * Simulate a bad link: delay every outgoing packet and drop some of them.
+ */
+extern void netplaySetConditions(int latencyMs, int lossPercent);
+
+/**
+ * Exchange input and, if the peer is not too far behind, run one frame.
+ * The keys pressed on both sides are combined.
+ *
+ * @param keys - local key mask, bit n for CHIP8 key n
+ *
+ * @return 1 if a frame was run, 0 if we are waiting for the peer
+ */
+extern int netplayFrame(u16 keys);
+
+/**
+ * Exchange input and correct mispredictions without running a new frame,
+ * e.g. while paused or to settle the last frames before stopping.
+ */
+extern void netplayPoll();
+
+extern const NetplayStats* netplayStats();
+
+extern void netplayClose();
+
+#endif
@@ -0,0 +1,53 @@
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "phosphor.h"
+
+static u8 __attribute__((aligned(16))) intensity[PHOSPHOR_MAX_PIXELS];
+static int phosphorDecay = 0;
+
+void setPhosphorDecay(int decay)
+{
+	if (decay < 0) decay = 0;
+	if (decay > 255) decay = 255;
+	if (decay && !phosphorDecay)
+		memset(intensity, 0, sizeof(intensity));
+	phosphorDecay = decay;
+}
+
+int getPhosphorDecay()
+{
+	return phosphorDecay;
+}
+
+const u8* blendPhosphor(const u8 *display, int count)
+{
+	int i = 0;
+	const unsigned decay = phosphorDecay;
+
+	if (!decay) return display;
+	if (count > PHOSPHOR_MAX_PIXELS) count = PHOSPHOR_MAX_PIXELS;
+
+#ifdef __SSE2__
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i k = _mm_set1_epi16(decay);
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i v = _mm_load_si128((const __m128i*)(intensity + i));
+			__m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), k), 8);
+			__m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), k), 8);
+			v = _mm_max_epu8(_mm_packus_epi16(lo, hi), _mm_loadu_si128((const __m128i*)(display + i)));
+			_mm_store_si128((__m128i*)(intensity + i), v);
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		unsigned v = (intensity[i] * decay) >> 8;
+		intensity[i] = display[i] > v ? display[i] : v;
+	}
+	return intensity;
+}
@@ -0,0 +1,24 @@
+#ifndef PHOSPHOR_H
+#define PHOSPHOR_H
+
+#include <psptypes.h>
+
+#define PHOSPHOR_MAX_PIXELS (128*64)
+
+/**
+ * Set how much of the previous intensity survives each frame, in 1/256ths.
+ * 0 disables persistence, the display is then passed through unchanged.
+ */
+extern void setPhosphorDecay(int decay);
+
+extern int getPhosphorDecay();
+
+/**
+ * Blend a new frame into the intensity buffer:
+ * intensity = max(pixel, intensity * decay / 256)
+ *
+ * @return the intensity buffer, valid until the next call
+ */
+extern const u8* blendPhosphor(const u8 *display, int count);
+
+#endif
@@ -21,27 +21,52 @@
 #include <pspaudiolib.h>
 #include <pspaudio.h>
 #include "graphics.h"
+#include "scaler.h"
+#include "phosphor.h"
+#include "timer.h"
+#include "frameskip.h"
+#include "romdb.h"
+#include "romcache.h"
+#include "input.h"
+#include "thread.h"
+#include "footprint.h"
 #include "psp.h"
 
-static volatile byte timer_count;               /* 55Hz counter             */
 static volatile byte keyb_status[256];          /* If 1, key is pressed     */
 static int  sync=1;                             /* If 0, do not sync        */
                                                 /* emulation                */
-static byte uperiod=1;                          /* number of interrupts per */
-                                                /* screen update            */
-                  
-
-static long ReadTimer (void)
-{
-#ifdef HAVE_CLOCK
- return (long)((float)clock()*1000000.0/(float)CLOCKS_PER_SEC);
-#else
- /* If clock() is unavailable, just return a large number */
- static long a=0;
- a+=1000000;
- return a;
+#define MAX_FRAMESKIP 4                         /* consecutive frames that  */
+                                                /* may go unpresented       */
+#define PHOSPHOR_DECAY 0xb0                     /* persistence when enabled */
+#define FRAME_PERIOD_NS 20000000                /* one timeslice, 1/50sec.  */
+#ifndef RUN_AHEAD
+#define RUN_AHEAD 0                             /* frames to run ahead of   */
+#endif                                          /* the one presented        */
+static FramePacer pacer;
+static FrameSkip frameskip;
+static u64 slice_start;                         /* when the current         */
+                                                /* timeslice began          */
+static RomSettings settings;                    /* settings of running ROM  */
+static InputQueue input;                        /* key changes from         */
+                                                /* input_thread             */
+static Thread input_reader;
+static volatile int input_stop;                 /* if 1, input_thread ends  */
+static volatile unsigned int pad_buttons;       /* last buttons it read     */
+static u64 window_start;                        /* start of the input       */
+                                                /* window of this timeslice */
+static int speculating;                         /* if 1, frames are run     */
+                                                /* ahead and thrown away    */
+#if RUN_AHEAD
+static struct chip8_state ahead_state;          /* machine before them      */
 #endif
-}
+#define FOOTPRINT_FILE "footprint.txt"          /* LOWMEM heap report       */
+static const unsigned int button_masks[ROMDB_BUTTONS]=
+{
+ PSP_CTRL_UP,PSP_CTRL_DOWN,PSP_CTRL_LEFT,PSP_CTRL_RIGHT,
+ PSP_CTRL_CROSS,PSP_CTRL_CIRCLE,PSP_CTRL_SQUARE,PSP_CTRL_TRIANGLE,
+ PSP_CTRL_LTRIGGER,PSP_CTRL_RTRIGGER
+};                                              /* in RomSettings.keymap    */
+                                                /* order                    */
 
 
 const float PI = 3.1415926535897932f;
@@ -95,6 +120,7 @@ static int sChannel = 0;
 /****************************************************************************/
 void chip8_sound_on (void)
 {
+	if (speculating) return;
 	pspAudioSetChannelCallback(sChannel, audioCallback, NULL);
 }
 
@@ -103,6 +129,7 @@ void chip8_sound_on (void)
 /****************************************************************************/
 void chip8_sound_off (void)
 {
+  if (speculating) return;
   pspAudioSetChannelCallback(sChannel, 0, NULL);
 }
 
@@ -111,77 +138,84 @@ void chip8_sound_off (void)
 /****************************************************************************/
 static void update_display (void)
 {
-	clearScreen(0x00);
-	
 	#ifdef CHIP8_SUPER
 	const int mag = 2;
   #else
   const int mag = 4;
   #endif
+	static Image *dis = NULL;
 
-	Image *dis = (Image*)malloc(sizeof(Image));
-	dis = createImage(CHIP8_WIDTH*mag, CHIP8_HEIGHT*mag);
-
-	u32 *od = dis->data;
-	byte *d = chip8_display;
-	
-	int i = 0;
-	for(int y=0;y<CHIP8_HEIGHT;y++)
+	if(!dis)
 	{
-		for(int my=0;my<mag;my++)
-		{
-			byte *dd = d;
-			for(int x=0;x<CHIP8_WIDTH;x++)
-			{  
-				for(int mx = 0;mx<mag;mx++)
-				{
-					if(*dd==0xff)
-			  		*od = 0xffffff;
-					else
-						*od = 0x000000;
-					od++;
-			  }
-			  dd++;
-			  i++;
-			}
-		}
-		d+=CHIP8_WIDTH;
+		dis = createImage(CHIP8_WIDTH*mag, CHIP8_HEIGHT*mag);
+		if(!dis) return;
 	}
+
+	clearScreen(0x00);
+
+	if(getPhosphorDecay())
+		scaleIntensity(blendPhosphor(chip8_display, sizeof(chip8_display)), CHIP8_WIDTH, CHIP8_HEIGHT, mag, dis->data, dis->textureWidth);
+	else
+		scaleDisplay(chip8_display, CHIP8_WIDTH, CHIP8_HEIGHT, mag, dis->data, dis->textureWidth);
 	blitImageToScreen(0, 0, dis->imageWidth, dis->imageHeight, dis, (480/2)-((CHIP8_WIDTH*mag)/2), (272/2)-((CHIP8_HEIGHT*mag)/2));
 	
 	flipScreen();
-  
-  freeImage(dis);
 }
 
+#if RUN_AHEAD
 /****************************************************************************/
-/* Update CHIP8 keyboard status                                             */
+/* Show the display RUN_AHEAD frames from now, assuming the keys stay as    */
+/* they are, then go back. Input shows up that many frames earlier when     */
+/* the guess is right; sound from the frames run ahead is not played        */
 /****************************************************************************/
-static void check_keys (void)
+static void update_display_ahead (void)
 {
-	memset (chip8_keys,0,sizeof(chip8_keys));
-	
-  SceCtrlData pad;
-  sceCtrlReadBufferPositive(&pad, 1);
-  if(pad.Buttons & PSP_CTRL_LEFT) chip8_keys[0x04] = 1;
-  if(pad.Buttons & PSP_CTRL_RIGHT) chip8_keys[0x06] = 1;
-  if(pad.Buttons & PSP_CTRL_UP) chip8_keys[0x08] = 1;
-  if(pad.Buttons & PSP_CTRL_DOWN) chip8_keys[0x02] = 1;
-  	
-  if(pad.Buttons & PSP_CTRL_SQUARE) chip8_keys[0x03] = 1;
-  if(pad.Buttons & PSP_CTRL_CIRCLE) chip8_keys[0x05] = 1;
-  if(pad.Buttons & PSP_CTRL_TRIANGLE) chip8_keys[0x07] = 1;
-  if(pad.Buttons & PSP_CTRL_CROSS) chip8_keys[0x01] = 1;
-  
-  if(pad.Buttons & PSP_CTRL_START) chip8_running = 0;
+ int i;
+ chip8_save_state (&ahead_state);
+ speculating=1;
+ for (i=0;i<RUN_AHEAD && chip8_running==1;++i)
+  chip8_frame ();
+ update_display ();
+ speculating=0;
+ chip8_load_state (&ahead_state);
 }
+#endif
 
 /****************************************************************************/
-/* Return time passed in 55th seconds                                       */
+/* Poll the pad between frames and queue every CHIP8 key change with the    */
+/* time it was seen                                                         */
 /****************************************************************************/
-static byte get_timer_count (void)
+static int input_thread (void *arg)
 {
- return timer_count;
+  u16 queued = 0;
+  while(!input_stop)
+  {
+    SceCtrlData pad;
+    u16 keys = 0;
+    sceCtrlPeekBufferPositive(&pad, 1);
+    for(int i=0;i<ROMDB_BUTTONS;i++)
+      if((pad.Buttons & button_masks[i]) && settings.keymap[i] < 16)
+        keys |= 1 << settings.keymap[i];
+    pad_buttons = pad.Buttons;
+    queued = inputPushMask(&input, timerNow(), queued, keys);
+    timerSleep(INPUT_POLL_NS);
+  }
+  return 0;
+}
+
+/****************************************************************************/
+/* Check the buttons that control the emulator; CHIP8 keys come from the    */
+/* input queue                                                              */
+/****************************************************************************/
+static void check_keys (void)
+{
+	static unsigned int old_buttons = 0;
+	unsigned int buttons = pad_buttons;
+
+  if(buttons & PSP_CTRL_START) chip8_running = 0;
+  if(buttons & ~old_buttons & PSP_CTRL_SELECT)
+    setPhosphorDecay(getPhosphorDecay() ? 0 : PHOSPHOR_DECAY);
+  old_buttons = buttons;
 }
 
 /****************************************************************************/
@@ -189,26 +223,22 @@ static byte get_timer_count (void)
 /****************************************************************************/
 void chip8_interrupt (void)
 {
- clock_t newtimer;
- static int ucount=1;
- if (!--ucount)
+ u64 now=timerNow ();
+ frameskipEmulated (&frameskip,now-slice_start);
+ if (!sync || frameskipPresent (&frameskip,now,pacer.deadline+pacer.period))
  {
-  ucount=uperiod;
+#if RUN_AHEAD
+  update_display_ahead ();
+#else
   update_display ();
+#endif
+  frameskipRendered (&frameskip,timerNow ()-now);
  }
  check_keys ();
+ footprintSample ();
  if (sync)
- {
-  newtimer=ReadTimer ();
-  timer_count+=20000;
-  if ((newtimer-timer_count)<0)
-  {
-   do
-    newtimer=ReadTimer ();
-   while ((newtimer-timer_count)<0);
-  }
-  else timer_count=newtimer;
- }
+  pacerWait (&pacer);
+ slice_start=timerNow ();
 }
 
 /****************************************************************************/
@@ -230,18 +260,42 @@ static void new_int9 (void)
 
 int Emulate(char *szFileName)
 {
-	FILE *file;
-	chip8_iperiod=15;
+	const RomSettings *known;
 	 
-	file = fopen(szFileName,"rb");
-	if(!file) return 0;
-		
-	int r = fread(chip8_mem+0x200,1,4096-0x200,file);
-	fclose(file);
+	int r = romcacheRead(szFileName, chip8_mem+0x200, 4096-0x200);
 	
-	if(r==0) return 0;
+	if(r<=0) return 0;
+
+	known = romdbFind(romdbHash(chip8_mem+0x200, r));
+	if(known) settings = *known;
+	else romdbDefaults(&settings);
+	chip8_iperiod = settings.iperiod;
+	chip8_quirks = settings.quirks;
+
+	pacerInit(&pacer, FRAME_PERIOD_NS);
+	frameskipInit(&frameskip, MAX_FRAMESKIP);
+	inputInit(&input);
+	input_stop = 0;
+	pad_buttons = 0;
+	if(!threadStart(&input_reader, "input_thread", 0x18, input_thread, NULL))
+		return 0;
 
-	chip8();
+	slice_start = window_start = timerNow();
+	chip8_reset();
+	chip8_run_mask = 0;
+	while (chip8_running == 1)
+	{
+		u64 window_end = slice_start;
+		if (inputRunSlice(&input, window_start, window_end) & CHIP8_RUN_FRAME)
+			chip8_interrupt();
+		window_start = window_end;
+	}
+
+	input_stop = 1;
+	threadJoin(&input_reader);
+#ifdef LOWMEM
+	footprintWrite(FOOTPRINT_FILE);
+#endif
 
   return 1;
 }
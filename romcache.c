@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "romcache.h"
+#include "rompack.h"
+#include "thread.h"
+
+#define ROMCACHE_WAIT 1000000   // us a read waits for a ROM the loader is reading
+
+enum { SLOT_EMPTY, SLOT_LOADING, SLOT_READY };
+
+typedef struct
+{
+	char szPath[ROMCACHE_PATH];
+	int state;
+	int size;
+	u32 lastUse;
+	u8 data[ROMCACHE_MAX];
+} Slot;
+
+static Slot slots[ROMCACHE_SLOTS];
+static char requests[ROMCACHE_SLOTS][ROMCACHE_PATH];
+static int numRequests = 0;
+static u32 useClock = 0;
+static Sema lock, work;
+static Sema loaded;             // signalled when a load ends while a read waits
+static int waiting = 0;
+static Thread loader;
+static int started = 0;
+
+#define LOCK()   semaWait(&lock)
+#define UNLOCK() semaSignal(&lock)
+
+static int readRom(const char *szPath, u8 *dst, int max)
+{
+	FILE *file;
+	int r = rompackLoadPath(szPath, dst, max);
+	if (r != -2) return r;
+
+	if (!(file = fopen(szPath, "rb"))) return -1;
+	r = fread(dst, 1, max, file);
+	fclose(file);
+	return r;
+}
+
+/* call with the lock held */
+static Slot* findSlot(const char *szPath)
+{
+	for (int i = 0; i < ROMCACHE_SLOTS; i++)
+		if (slots[i].state != SLOT_EMPTY && !strcmp(slots[i].szPath, szPath))
+			return &slots[i];
+	return NULL;
+}
+
+/* call with the lock held; least recently used slot that is not loading */
+static Slot* victimSlot(void)
+{
+	Slot *v = NULL;
+	for (int i = 0; i < ROMCACHE_SLOTS; i++)
+	{
+		if (slots[i].state == SLOT_EMPTY) return &slots[i];
+		if (slots[i].state == SLOT_READY && (!v || slots[i].lastUse < v->lastUse))
+			v = &slots[i];
+	}
+	return v;
+}
+
+static int loaderThread(void *arg)
+{
+	char szPath[ROMCACHE_PATH];
+
+	while (1)
+	{
+		Slot *s;
+
+		semaWait(&work);
+		while (1)
+		{
+			LOCK();
+			/* take the most wanted request that is not cached yet */
+			s = NULL;
+			while (numRequests > 0)
+			{
+				strcpy(szPath, requests[0]);
+				memmove(requests[0], requests[1], --numRequests * ROMCACHE_PATH);
+				if (!findSlot(szPath) && (s = victimSlot()))
+				{
+					strcpy(s->szPath, szPath);
+					s->state = SLOT_LOADING;
+					break;
+				}
+			}
+			UNLOCK();
+			if (!s) break;
+
+			/* the slot is ours while it is marked as loading */
+			int size = readRom(szPath, s->data, ROMCACHE_MAX);
+
+			LOCK();
+			s->size = size;
+			s->state = size > 0 ? SLOT_READY : SLOT_EMPTY;
+			s->lastUse = useClock;
+			if (waiting) semaSignal(&loaded);
+			UNLOCK();
+		}
+	}
+	return 0;
+}
+
+void romcacheInit()
+{
+	if (!semaInit(&lock, 1) || !semaInit(&work, 0) || !semaInit(&loaded, 0)) return;
+	started = threadStart(&loader, "romcache_thread", 0x30, loaderThread, NULL);
+}
+
+void romcachePrefetch(const char **paths, int count)
+{
+	if (!started) return;
+	if (count > ROMCACHE_SLOTS) count = ROMCACHE_SLOTS;
+
+	LOCK();
+	useClock++;
+	numRequests = 0;
+	for (int i = 0; i < count; i++)
+	{
+		Slot *s = findSlot(paths[i]);
+		if (s)
+		{
+			/* keep wanted ROMs from being evicted */
+			s->lastUse = useClock;
+			continue;
+		}
+		strncpy(requests[numRequests], paths[i], ROMCACHE_PATH - 1);
+		requests[numRequests][ROMCACHE_PATH - 1] = 0;
+		numRequests++;
+	}
+	UNLOCK();
+	if (numRequests)
+		semaSignal(&work);
+}
+
+int romcacheRead(const char *szPath, u8 *dst, int max)
+{
+	Slot *s;
+	int size = -1;
+
+	if (!started) return readRom(szPath, dst, max);
+
+	LOCK();
+	s = findSlot(szPath);
+	if (s && s->state == SLOT_LOADING)
+	{
+		/* the loader is reading it already; there is only one loader, so
+		   the next load to end is this one */
+		waiting = 1;
+		UNLOCK();
+		semaWaitTimeout(&loaded, ROMCACHE_WAIT);
+		LOCK();
+		waiting = 0;
+		while (semaTryWait(&loaded))
+			;
+		s = findSlot(szPath);
+	}
+	if (s && s->state == SLOT_READY)
+	{
+		size = s->size < max ? s->size : max;
+		memcpy(dst, s->data, size);
+		s->lastUse = ++useClock;
+	}
+	UNLOCK();
+	if (size > 0) return size;
+
+	size = readRom(szPath, dst, max);
+	if (size > 0 && strlen(szPath) < ROMCACHE_PATH)
+	{
+		LOCK();
+		if (!findSlot(szPath) && (s = victimSlot()))
+		{
+			strcpy(s->szPath, szPath);
+			s->size = size < ROMCACHE_MAX ? size : ROMCACHE_MAX;
+			memcpy(s->data, dst, s->size);
+			s->state = SLOT_READY;
+			s->lastUse = ++useClock;
+		}
+		UNLOCK();
+	}
+	return size;
+}
@@ -0,0 +1,35 @@
+#ifndef ROMCACHE_H
+#define ROMCACHE_H
+
+#include <psptypes.h>
+
+#ifdef LOWMEM
+#define ROMCACHE_SLOTS 2
+#else
+#define ROMCACHE_SLOTS 8
+#endif
+#define ROMCACHE_PATH 512
+#define ROMCACHE_MAX (4096-0x200)
+
+/**
+ * Start the background loader thread.
+ */
+extern void romcacheInit();
+
+/**
+ * Ask the loader to bring these ROMs into the cache, most wanted first.
+ * Replaces any earlier request that has not been served yet.
+ */
+extern void romcachePrefetch(const char **paths, int count);
+
+/**
+ * Copy a ROM to dst, from the cache when it is there, otherwise straight
+ * from the memory stick (the image is then cached for a re-launch). A ROM
+ * the loader is reading right now is waited for, up to a second, rather
+ * than read twice. Paths inside a pack ("<pack>.c8p/<name>") are supported.
+ *
+ * @return number of bytes copied, or <= 0 on error
+ */
+extern int romcacheRead(const char *szPath, u8 *dst, int max);
+
+#endif
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef __psp__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "romdb.h"
+
+static const RomSettings *records = NULL;
+static int numRecords = 0;
+static void *image = NULL;
+static size_t imageSize = 0;
+
+u64 romdbHash(const u8 *data, int size)
+{
+	u64 h = 0xcbf29ce484222325ULL;
+	while (size--)
+	{
+		h ^= *data++;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+void romdbDefaults(RomSettings *settings)
+{
+	static const u8 keymap[ROMDB_BUTTONS] =
+	{
+		0x08, 0x02, 0x04, 0x06,     // up, down, left, right
+		0x01, 0x05, 0x03, 0x07,     // cross, circle, square, triangle
+		ROMDB_UNMAPPED, ROMDB_UNMAPPED
+	};
+
+	memset(settings, 0, sizeof(RomSettings));
+	settings->iperiod = 15;
+	memcpy(settings->keymap, keymap, sizeof(keymap));
+}
+
+void romdbClose()
+{
+	if (image)
+	{
+#ifdef __psp__
+		free(image);
+#else
+		munmap(image, imageSize);
+#endif
+	}
+	image = NULL;
+	imageSize = 0;
+	records = NULL;
+	numRecords = 0;
+}
+
+int romdbOpen(const char *szPath)
+{
+	const RomDBHeader *hdr;
+
+	romdbClose();
+#ifdef __psp__
+	FILE *file = fopen(szPath, "rb");
+	if (!file) return -1;
+	fseek(file, 0, SEEK_END);
+	imageSize = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	image = malloc(imageSize);
+	if (!image || fread(image, 1, imageSize, file) != imageSize)
+	{
+		fclose(file);
+		romdbClose();
+		return -1;
+	}
+	fclose(file);
+#else
+	struct stat st;
+	int fd = open(szPath, O_RDONLY);
+	if (fd < 0) return -1;
+	if (fstat(fd, &st) < 0 || st.st_size == 0)
+	{
+		close(fd);
+		return -1;
+	}
+	imageSize = st.st_size;
+	image = mmap(NULL, imageSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED)
+	{
+		image = NULL;
+		return -1;
+	}
+#endif
+
+	hdr = (const RomDBHeader*) image;
+	if (imageSize < sizeof(RomDBHeader) || hdr->magic != ROMDB_MAGIC ||
+	    hdr->version != ROMDB_VERSION || hdr->recordSize != sizeof(RomSettings) ||
+	    imageSize < sizeof(RomDBHeader) + (size_t)hdr->count * sizeof(RomSettings))
+	{
+		romdbClose();
+		return -1;
+	}
+	records = (const RomSettings*) (hdr + 1);
+	numRecords = hdr->count;
+	return numRecords;
+}
+
+const RomSettings* romdbFind(u64 hash)
+{
+	int lo = 0, hi = numRecords - 1;
+	while (lo <= hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (records[mid].hash == hash) return &records[mid];
+		if (records[mid].hash < hash) lo = mid + 1;
+		else hi = mid - 1;
+	}
+	return NULL;
+}
+
+static int compareRecords(const void *a, const void *b)
+{
+	u64 x = ((const RomSettings*)a)->hash, y = ((const RomSettings*)b)->hash;
+	return x < y ? -1 : x > y;
+}
+
+int romdbWrite(const char *szPath, RomSettings *recs, int count)
+{
+	RomDBHeader hdr;
+	FILE *file;
+	int ok;
+
+	qsort(recs, count, sizeof(RomSettings), compareRecords);
+	hdr.magic = ROMDB_MAGIC;
+	hdr.version = ROMDB_VERSION;
+	hdr.count = count;
+	hdr.recordSize = sizeof(RomSettings);
+
+	if (!(file = fopen(szPath, "wb"))) return 0;
+	ok = fwrite(&hdr, sizeof(hdr), 1, file) == 1 &&
+	     fwrite(recs, sizeof(RomSettings), count, file) == (size_t)count;
+	return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,77 @@
+#ifndef ROMDB_H
+#define ROMDB_H
+
+#include <psptypes.h>
+
+/* On-disk ROM database: a RomDBHeader followed by count RomSettings
+   records sorted by hash. The file is used in place, little endian, so
+   loading it is a single read (or mmap on a host) and lookups are a
+   binary search. */
+
+#define ROMDB_MAGIC 0x42443843      // "C8DB"
+#define ROMDB_VERSION 1
+
+enum { ROMDB_CHIP8 = 0, ROMDB_SCHIP = 1 };
+
+/* PSP buttons that can be mapped onto CHIP8 keys, in keymap order */
+enum
+{
+	ROMDB_UP, ROMDB_DOWN, ROMDB_LEFT, ROMDB_RIGHT,
+	ROMDB_CROSS, ROMDB_CIRCLE, ROMDB_SQUARE, ROMDB_TRIANGLE,
+	ROMDB_LTRIGGER, ROMDB_RTRIGGER,
+	ROMDB_BUTTONS
+};
+
+#define ROMDB_UNMAPPED 0xff
+
+typedef struct
+{
+	u32 magic;
+	u32 version;
+	u32 count;
+	u32 recordSize;
+} RomDBHeader;
+
+typedef struct
+{
+	u64 hash;                   // romdbHash of the ROM image
+	u8 iperiod;                 // opcodes per timeslice
+	u8 quirks;                  // CHIP8_QUIRK_* flags
+	u8 machine;                 // ROMDB_CHIP8 or ROMDB_SCHIP
+	u8 reserved;
+	u8 keymap[ROMDB_BUTTONS];   // CHIP8 key per button or ROMDB_UNMAPPED
+	u8 pad[2];
+} RomSettings;
+
+/**
+ * 64-bit FNV-1a hash of a ROM image.
+ */
+extern u64 romdbHash(const u8 *data, int size);
+
+/**
+ * Settings used for ROMs that are not in the database.
+ */
+extern void romdbDefaults(RomSettings *settings);
+
+/**
+ * Load the database, replacing any previously loaded one.
+ *
+ * @return number of records, or -1 if the file is missing or invalid
+ */
+extern int romdbOpen(const char *szPath);
+
+extern void romdbClose();
+
+/**
+ * @return the settings stored for hash, or NULL if unknown
+ */
+extern const RomSettings* romdbFind(u64 hash);
+
+/**
+ * Sort records by hash and write them as a database file.
+ *
+ * @return 1 on success, 0 on failure
+ */
+extern int romdbWrite(const char *szPath, RomSettings *records, int count);
+
+#endif
@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "rompack.h"
+
+#define READ_CHUNK 512
+
+int rompackOpen(RomPack *pack, const char *szPath)
+{
+	RomPackHeader hdr;
+
+	pack->count = 0;
+	pack->entries = NULL;
+	if (!(pack->file = fopen(szPath, "rb"))) return 0;
+
+	if (fread(&hdr, sizeof(hdr), 1, pack->file) != 1 || hdr.magic != ROMPACK_MAGIC ||
+	    hdr.version != ROMPACK_VERSION || hdr.entrySize != sizeof(RomPackEntry))
+	{
+		rompackClose(pack);
+		return 0;
+	}
+#ifdef LOWMEM
+	if (hdr.count > ROMPACK_MAX) hdr.count = ROMPACK_MAX;
+	pack->entries = pack->space;
+#else
+	pack->entries = (RomPackEntry*) malloc(hdr.count * sizeof(RomPackEntry) + 1);
+#endif
+	if (!pack->entries || fread(pack->entries, sizeof(RomPackEntry), hdr.count, pack->file) != hdr.count)
+	{
+		rompackClose(pack);
+		return 0;
+	}
+	pack->count = hdr.count;
+	for (int i = 0; i < pack->count; i++)
+		pack->entries[i].name[ROMPACK_NAME - 1] = 0;
+	return 1;
+}
+
+void rompackClose(RomPack *pack)
+{
+	if (pack->file) fclose(pack->file);
+#ifndef LOWMEM
+	free(pack->entries);
+#endif
+	pack->file = NULL;
+	pack->entries = NULL;
+	pack->count = 0;
+}
+
+int rompackFind(const RomPack *pack, const char *szName)
+{
+	for (int i = 0; i < pack->count; i++)
+		if (!strcasecmp(pack->entries[i].name, szName))
+			return i;
+	return -1;
+}
+
+/* buffered reader over the packed bytes of one entry */
+typedef struct
+{
+	FILE *file;
+	u32 left;
+	int pos, len;
+	u8 buf[READ_CHUNK];
+} Input;
+
+static int nextByte(Input *in)
+{
+	if (in->pos == in->len)
+	{
+		int n = in->left < READ_CHUNK ? in->left : READ_CHUNK;
+		if (!n || (int)fread(in->buf, 1, n, in->file) != n) return -1;
+		in->left -= n;
+		in->pos = 0;
+		in->len = n;
+	}
+	return in->buf[in->pos++];
+}
+
+static int loadEntry(FILE *file, const RomPackEntry *e, u8 *dst, int max)
+{
+	Input in;
+	int out = 0, flags = 0, c;
+
+	if (fseek(file, e->offset, SEEK_SET)) return -1;
+	if ((int)e->size < max) max = e->size;
+
+	if (e->method == ROMPACK_STORED)
+		return (int)fread(dst, 1, max, file) == max ? max : -1;
+	if (e->method != ROMPACK_LZSS) return -1;
+
+	in.file = file;
+	in.left = e->packedSize;
+	in.pos = in.len = 0;
+	while (out < max)
+	{
+		if (!(flags & 0x100))
+		{
+			if ((c = nextByte(&in)) < 0) return -1;
+			flags = c | 0xff00;
+		}
+		if (flags & 1)
+		{
+			if ((c = nextByte(&in)) < 0) return -1;
+			dst[out++] = c;
+		}
+		else
+		{
+			int hi = nextByte(&in), lo = nextByte(&in), dist, len;
+			if (hi < 0 || lo < 0) return -1;
+			dist = ((hi << 4) | (lo >> 4)) + 1;
+			len = (lo & 0x0f) + ROMPACK_MIN_MATCH;
+			if (dist > out) return -1;
+			/* matches may overlap their own output, copy bytewise */
+			for (; len && out < max; len--, out++)
+				dst[out] = dst[out - dist];
+		}
+		flags >>= 1;
+	}
+	return out;
+}
+
+int rompackLoad(RomPack *pack, int n, u8 *dst, int max)
+{
+	if (n < 0 || n >= pack->count) return -1;
+	return loadEntry(pack->file, &pack->entries[n], dst, max);
+}
+
+int rompackIsPack(const char *szPath)
+{
+	size_t n = strlen(szPath), e = strlen(ROMPACK_EXT);
+	return n > e && !strcasecmp(szPath + n - e, ROMPACK_EXT);
+}
+
+int rompackLoadPath(const char *szPath, u8 *dst, int max)
+{
+	char szPack[512];
+	const char *slash = strrchr(szPath, '/');
+	RomPackHeader hdr;
+	RomPackEntry e;
+	FILE *file;
+	u32 i;
+	int r = -1;
+
+	if (!slash || slash - szPath >= (int)sizeof(szPack)) return -2;
+	memcpy(szPack, szPath, slash - szPath);
+	szPack[slash - szPath] = 0;
+	if (!rompackIsPack(szPack)) return -2;
+
+	/* walk the index instead of loading it, one entry is all we need */
+	if (!(file = fopen(szPack, "rb"))) return -1;
+	if (fread(&hdr, sizeof(hdr), 1, file) == 1 && hdr.magic == ROMPACK_MAGIC &&
+	    hdr.version == ROMPACK_VERSION && hdr.entrySize == sizeof(RomPackEntry))
+	{
+		for (i = 0; i < hdr.count && fread(&e, sizeof(e), 1, file) == 1; i++)
+		{
+			e.name[ROMPACK_NAME - 1] = 0;
+			if (!strcasecmp(e.name, slash + 1))
+			{
+				r = loadEntry(file, &e, dst, max);
+				break;
+			}
+		}
+	}
+	fclose(file);
+	return r;
+}
@@ -0,0 +1,89 @@
+#ifndef ROMPACK_H
+#define ROMPACK_H
+
+#include <stdio.h>
+#include <psptypes.h>
+
+/* ROM pack: a RomPackHeader, then count RomPackEntry records (the central
+   index), then the ROM data. Listing a pack only reads the index; each
+   ROM is either stored or LZSS compressed and is decoded straight into
+   its destination. */
+
+#define ROMPACK_MAGIC 0x4b503843    // "C8PK"
+#define ROMPACK_VERSION 1
+#define ROMPACK_EXT ".c8p"
+#define ROMPACK_NAME 48
+#ifdef LOWMEM
+#define ROMPACK_MAX 256             // entries of a pack that get listed
+#endif
+
+enum { ROMPACK_STORED = 0, ROMPACK_LZSS = 1 };
+
+/* LZSS stream: a flag byte announces the next 8 items, LSB first. A set
+   bit is a literal byte, a clear bit a 2-byte match: 12 bits distance-1
+   then 4 bits length-ROMPACK_MIN_MATCH, both high nibble first. */
+#define ROMPACK_WINDOW 4096
+#define ROMPACK_MIN_MATCH 3
+#define ROMPACK_MAX_MATCH (15 + ROMPACK_MIN_MATCH)
+
+typedef struct
+{
+	u32 magic;
+	u32 version;
+	u32 count;
+	u32 entrySize;
+} RomPackHeader;
+
+typedef struct
+{
+	char name[ROMPACK_NAME];
+	u32 offset;         // from the start of the file
+	u32 packedSize;
+	u32 size;
+	u32 method;
+} RomPackEntry;
+
+typedef struct
+{
+	FILE *file;
+	int count;
+	RomPackEntry *entries;
+#ifdef LOWMEM
+	RomPackEntry space[ROMPACK_MAX];
+#endif
+} RomPack;
+
+/**
+ * Open a pack and read its index.
+ *
+ * @return 1 on success, 0 on failure
+ */
+extern int rompackOpen(RomPack *pack, const char *szPath);
+
+extern void rompackClose(RomPack *pack);
+
+/**
+ * @return index of the entry called szName, or -1
+ */
+extern int rompackFind(const RomPack *pack, const char *szName);
+
+/**
+ * Decompress entry n into dst, writing at most max bytes.
+ *
+ * @return number of bytes written, or -1 on a read or format error
+ */
+extern int rompackLoad(RomPack *pack, int n, u8 *dst, int max);
+
+/**
+ * @return 1 if szPath names a pack file
+ */
+extern int rompackIsPack(const char *szPath);
+
+/**
+ * Load a ROM given as "<pack>.c8p/<entry>".
+ *
+ * @return bytes loaded, -1 on error, or -2 if szPath is not inside a pack
+ */
+extern int rompackLoadPath(const char *szPath, u8 *dst, int max);
+
+#endif
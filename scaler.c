@@ -0,0 +1,122 @@
+#include <string.h>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "scaler.h"
+
+/* expanded output for every combination of 8 source pixels at the
+   current scale, bit n of the index is source pixel n */
+static Color __attribute__((aligned(16))) scaleLut[256*8*SCALER_MAX_SCALE];
+static int lutScale = 0;
+/* colour for every intensity between colorOff (0) and colorOn (255) */
+static Color rampLut[256];
+static int rampValid = 0;
+static Color colorOn = 0xffffff;
+static Color colorOff = 0x000000;
+
+static void buildLut(int scale)
+{
+	int mask, bit, i;
+	Color *p = scaleLut;
+
+	for (mask = 0; mask < 256; mask++)
+		for (bit = 0; bit < 8; bit++)
+			for (i = 0; i < scale; i++)
+				*p++ = (mask & (1 << bit)) ? colorOn : colorOff;
+	lutScale = scale;
+}
+
+void setScalerColors(Color on, Color off)
+{
+	colorOn = on;
+	colorOff = off;
+	lutScale = 0;
+	rampValid = 0;
+}
+
+static void buildRamp(void)
+{
+	int v, shift;
+
+	for (v = 0; v < 256; v++)
+	{
+		Color c = 0;
+		for (shift = 0; shift < 32; shift += 8)
+		{
+			int a = (colorOff >> shift) & 0xff;
+			int b = (colorOn >> shift) & 0xff;
+			c |= (Color)((a + ((b - a) * v) / 255) & 0xff) << shift;
+		}
+		rampLut[v] = c;
+	}
+	rampValid = 1;
+}
+
+/* gather bit 7 of 8 consecutive pixels into one byte, pixel 0 in bit 0 */
+static inline unsigned packPixels(const u8 *src)
+{
+	uint64_t v;
+	memcpy(&v, src, 8);
+	return (unsigned)((((v >> 7) & 0x0101010101010101ULL) * 0x0102040810204080ULL) >> 56);
+}
+
+void scaleDisplay(const u8 *src, int width, int height, int scale, Color *dst, int pitch)
+{
+	int x, y, i, span;
+	size_t spanBytes, rowBytes;
+
+	if (scale < 1) scale = 1;
+	if (scale > SCALER_MAX_SCALE) scale = SCALER_MAX_SCALE;
+	if (scale != lutScale) buildLut(scale);
+
+	span = 8 * scale;
+	spanBytes = span * sizeof(Color);
+	rowBytes = width * scale * sizeof(Color);
+
+	for (y = 0; y < height; y++, src += width)
+	{
+		Color *out = dst;
+		x = 0;
+#ifdef __SSE2__
+		for (; x + 16 <= width; x += 16, out += 2 * span)
+		{
+			unsigned m = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(src + x)));
+			memcpy(out, scaleLut + (m & 0xff) * span, spanBytes);
+			memcpy(out + span, scaleLut + (m >> 8) * span, spanBytes);
+		}
+#endif
+		for (; x < width; x += 8, out += span)
+			memcpy(out, scaleLut + packPixels(src + x) * span, spanBytes);
+
+		for (i = 1; i < scale; i++)
+			memcpy(dst + i * pitch, dst, rowBytes);
+		dst += scale * pitch;
+	}
+}
+
+void scaleIntensity(const u8 *src, int width, int height, int scale, Color *dst, int pitch)
+{
+	int x, y, i;
+	size_t rowBytes;
+
+	if (scale < 1) scale = 1;
+	if (scale > SCALER_MAX_SCALE) scale = SCALER_MAX_SCALE;
+	if (!rampValid) buildRamp();
+
+	rowBytes = width * scale * sizeof(Color);
+	for (y = 0; y < height; y++, src += width)
+	{
+		Color *out = dst;
+		for (x = 0; x < width; x++)
+		{
+			Color c = rampLut[src[x]];
+			for (i = 0; i < scale; i++)
+				*out++ = c;
+		}
+		for (i = 1; i < scale; i++)
+			memcpy(dst + i * pitch, dst, rowBytes);
+		dst += scale * pitch;
+	}
+}
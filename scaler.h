@@ -0,0 +1,28 @@
+#ifndef SCALER_H
+#define SCALER_H
+
+#include "graphics.h"
+
+#define SCALER_MAX_SCALE 8
+
+/**
+ * Set the colours used for lit and unlit CHIP8 pixels.
+ */
+extern void setScalerColors(Color on, Color off);
+
+/**
+ * Expand a CHIP8 display (one byte per pixel, 0xff or 0x00) into a 32-bit
+ * surface, magnified by an integer factor of 1 to SCALER_MAX_SCALE.
+ *
+ * @param width - source width in pixels, must be a multiple of 8
+ * @param pitch - destination line length in pixels
+ */
+extern void scaleDisplay(const u8 *src, int width, int height, int scale, Color *dst, int pitch);
+
+/**
+ * Like scaleDisplay, but for a greyscale intensity buffer where 0 maps to
+ * the unlit colour, 255 to the lit colour and values in between blend.
+ */
+extern void scaleIntensity(const u8 *src, int width, int height, int scale, Color *dst, int pitch);
+
+#endif
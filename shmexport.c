@@ -0,0 +1,186 @@
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shmexport.h"
+
+#define RING_SIZE (sizeof(ShmExportHeader) + SHMEXPORT_SLOTS * sizeof(ShmExportSlot))
+
+static ShmExportHeader *header = NULL;
+static ShmExportSlot *slots;
+static char name[64];
+
+int shmExportOpen(const char *szName, const ShmWindow *windows, int count)
+{
+	int fd, w, bytes = 0;
+	void *map;
+
+	if (header || count < 0 || count > SHMEXPORT_WINDOWS || strlen(szName) >= sizeof(name)) return 0;
+	for (w = 0; w < count; w++)
+	{
+		/* a window of size 0 ends the list */
+		if (!windows[w].size || windows[w].addr + windows[w].size > 4096) return 0;
+		bytes += windows[w].size;
+	}
+	if (bytes > SHMEXPORT_WINDOW_BYTES) return 0;
+
+	fd = shm_open(szName, O_CREAT | O_RDWR, 0644);
+	if (fd < 0) return 0;
+	if (ftruncate(fd, RING_SIZE) < 0)
+	{
+		close(fd);
+		shm_unlink(szName);
+		return 0;
+	}
+	map = mmap(NULL, RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		shm_unlink(szName);
+		return 0;
+	}
+	strcpy(name, szName);
+	header = (ShmExportHeader*) map;
+	slots = (ShmExportSlot*) (header + 1);
+
+	/* readers check the magic last */
+	memset(map, 0, RING_SIZE);
+	header->version = SHMEXPORT_VERSION;
+	header->slots = SHMEXPORT_SLOTS;
+	header->slotSize = sizeof(ShmExportSlot);
+	header->width = CHIP8_WIDTH;
+	header->height = CHIP8_HEIGHT;
+	for (w = 0; w < count; w++)
+		header->window[w] = windows[w];
+	__atomic_store_n(&header->magic, SHMEXPORT_MAGIC, __ATOMIC_RELEASE);
+	return 1;
+}
+
+int shmExportActive()
+{
+	return header != NULL;
+}
+
+void shmExportFrame()
+{
+	u32 frame = header->head;
+	ShmExportSlot *slot = &slots[frame & (SHMEXPORT_SLOTS - 1)];
+	u8 *mem = slot->mem;
+	int w;
+
+	__atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	slot->frame = frame;
+	memcpy(slot->v, chip8_regs.alg, 16);
+	slot->delay = chip8_regs.delay;
+	slot->sound = chip8_regs.sound;
+	slot->i = chip8_regs.i;
+	slot->pc = chip8_regs.pc;
+	slot->sp = chip8_regs.sp;
+	slot->keys = chip8_keys;
+	slot->running = chip8_running;
+	memcpy(slot->display, chip8_display, sizeof(slot->display));
+	for (w = 0; w < SHMEXPORT_WINDOWS && header->window[w].size; w++)
+	{
+		memcpy(mem, chip8_mem + header->window[w].addr, header->window[w].size);
+		mem += header->window[w].size;
+	}
+	__atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&header->head, frame + 1, __ATOMIC_RELEASE);
+}
+
+void shmExportClose()
+{
+	if (!header) return;
+	__atomic_store_n(&header->closed, 1, __ATOMIC_RELEASE);
+	munmap(header, RING_SIZE);
+	shm_unlink(name);
+	header = NULL;
+}
+
+int shmReaderOpen(ShmReader *reader, const char *szName)
+{
+	struct stat st;
+	void *map;
+	int fd = shm_open(szName, O_RDONLY, 0);
+
+	memset(reader, 0, sizeof(*reader));
+	if (fd < 0) return 0;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(ShmExportHeader))
+	{
+		close(fd);
+		return 0;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return 0;
+	reader->header = (const ShmExportHeader*) map;
+	reader->slots = (const u8*) map + sizeof(ShmExportHeader);
+	reader->size = st.st_size;
+	if (__atomic_load_n(&reader->header->magic, __ATOMIC_ACQUIRE) != SHMEXPORT_MAGIC ||
+	    reader->header->version != SHMEXPORT_VERSION ||
+	    reader->header->slotSize < sizeof(ShmExportSlot) ||
+	    sizeof(ShmExportHeader) + (u64)reader->header->slots * reader->header->slotSize > reader->size)
+	{
+		shmReaderClose(reader);
+		return 0;
+	}
+	return 1;
+}
+
+void shmReaderClose(ShmReader *reader)
+{
+	if (reader->header)
+		munmap((void*) reader->header, reader->size);
+	memset(reader, 0, sizeof(*reader));
+}
+
+u32 shmReaderHead(const ShmReader *reader)
+{
+	return __atomic_load_n(&reader->header->head, __ATOMIC_ACQUIRE);
+}
+
+int shmReaderClosed(const ShmReader *reader)
+{
+	return __atomic_load_n(&reader->header->closed, __ATOMIC_ACQUIRE);
+}
+
+const ShmExportSlot* shmReaderBegin(const ShmReader *reader, u32 frame, u32 *seq)
+{
+	const ShmExportSlot *slot = (const ShmExportSlot*)
+		(reader->slots + (frame % reader->header->slots) * reader->header->slotSize);
+
+	*seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+	if (!*seq || *seq & 1 || __atomic_load_n(&slot->frame, __ATOMIC_RELAXED) != frame) return NULL;
+	return slot;
+}
+
+int shmReaderEnd(const ShmReader *reader, const ShmExportSlot *slot, u32 seq)
+{
+	(void)reader;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq;
+}
+
+int shmReaderLatest(const ShmReader *reader, ShmExportSlot *out)
+{
+	const ShmExportSlot *slot;
+	u32 head, seq;
+	int tries;
+
+	for (tries = 0; tries < SHMREADER_TRIES; tries++)
+	{
+		head = shmReaderHead(reader);
+		if (!head) return 0;
+		if ((slot = shmReaderBegin(reader, head - 1, &seq)))
+		{
+			memcpy(out, slot, sizeof(*out));
+			if (shmReaderEnd(reader, slot, seq)) return 1;
+		}
+		/* nothing overwrites the last frame any more: it will not get better */
+		if (shmReaderClosed(reader)) return 0;
+	}
+	return 0;
+}
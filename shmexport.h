@@ -0,0 +1,127 @@
+#ifndef SHMEXPORT_H
+#define SHMEXPORT_H
+
+#include <psptypes.h>
+#include "CHIP8.h"
+
+/* Every finished frame published to POSIX shared memory for other
+   processes: the display, the registers and a few windows of guest
+   memory. The frames go round a ring of slots, each guarded by a
+   sequence number that is odd while the slot is written. Readers map
+   the ring and read slots in place; they never write to it, so a slow
+   or stuck reader cannot hold up the emulator, it just finds that the
+   frame it was reading has been overwritten and tries a newer one.
+   Host builds only. */
+#define SHMEXPORT_MAGIC 0x58453843  // "C8EX"
+#define SHMEXPORT_VERSION 1
+
+#define SHMEXPORT_SLOTS 8           // frames kept, power of 2
+#define SHMEXPORT_WINDOWS 4
+#define SHMEXPORT_WINDOW_BYTES 1024 // all windows together
+#define SHMREADER_TRIES 16          // shmReaderLatest reads before giving up
+
+typedef struct
+{
+	u16 addr, size;     // size 0: unused
+} ShmWindow;
+
+typedef struct
+{
+	u32 magic;
+	u16 version;
+	u16 slots;
+	u32 slotSize;       // bytes from one slot to the next
+	u16 width, height;
+	ShmWindow window[SHMEXPORT_WINDOWS];
+	u32 head;           // frames published; frame f is in slot f % slots
+	u32 closed;         // the emulator has stopped
+	u32 pad[6];
+} ShmExportHeader;
+
+typedef struct
+{
+	u32 seq;            // odd while the slot is written
+	u32 frame;
+	u8 v[16];
+	u8 delay, sound;
+	u16 i, pc, sp;
+	u16 keys;
+	u8 running;
+	u8 pad;
+	u8 display[CHIP8_WIDTH*CHIP8_HEIGHT];
+	u8 mem[SHMEXPORT_WINDOW_BYTES];     // the windows, one after another
+} ShmExportSlot;
+
+/**
+ * Create the shared memory object, e.g. "/chip8", and start publishing.
+ *
+ * @param windows - count ranges of guest memory to publish with every
+ * frame, none empty, at most SHMEXPORT_WINDOWS and SHMEXPORT_WINDOW_BYTES
+ * together
+ *
+ * @return 1 on success, 0 on failure
+ */
+extern int shmExportOpen(const char *szName, const ShmWindow *windows, int count);
+
+extern int shmExportActive();
+
+/**
+ * Publish the machine as it is now, at the end of a frame.
+ */
+extern void shmExportFrame();
+
+/**
+ * Mark the ring closed and remove its name; readers that have it mapped
+ * can still read the last frames.
+ */
+extern void shmExportClose();
+
+/* the reader side */
+
+typedef struct
+{
+	const ShmExportHeader *header;
+	const u8 *slots;
+	u32 size;           // bytes mapped
+} ShmReader;
+
+/**
+ * @return 1 on success, 0 if there is no ring of this version by that name
+ */
+extern int shmReaderOpen(ShmReader *reader, const char *szName);
+
+extern void shmReaderClose(ShmReader *reader);
+
+/**
+ * @return frames published so far; the newest is the one before
+ */
+extern u32 shmReaderHead(const ShmReader *reader);
+
+extern int shmReaderClosed(const ShmReader *reader);
+
+/**
+ * Start reading a frame in place. Once done with it, shmReaderEnd tells
+ * whether it was overwritten meanwhile; until then nothing read from the
+ * slot can be trusted.
+ *
+ * @return the slot, or NULL if the frame is not in the ring: not
+ * published yet, being written or already overwritten
+ */
+extern const ShmExportSlot* shmReaderBegin(const ShmReader *reader, u32 frame, u32 *seq);
+
+/**
+ * @return 1 if the slot still holds the frame shmReaderBegin found
+ */
+extern int shmReaderEnd(const ShmReader *reader, const ShmExportSlot *slot, u32 seq);
+
+/**
+ * Copy the newest frame out, trying again while the emulator overwrites
+ * it, up to SHMREADER_TRIES times.
+ *
+ * @return 1 on success, 0 if nothing was published yet or no whole frame
+ * could be read: the emulator kept overwriting it, or closed the ring
+ * with a frame that cannot be read
+ */
+extern int shmReaderLatest(const ShmReader *reader, ShmExportSlot *out);
+
+#endif
@@ -0,0 +1,147 @@
+#include <stdlib.h>
+#ifndef __psp__
+#include <errno.h>
+#include <time.h>
+#endif
+
+#include "thread.h"
+
+#define THREAD_STACK 0x4000
+
+typedef struct
+{
+	ThreadFunc func;
+	void *arg;
+} Start;
+
+#ifdef __psp__
+
+static int trampoline(SceSize args, void *argp)
+{
+	Start *s = (Start*) argp;
+	return s->func(s->arg);
+}
+
+int threadStart(Thread *thread, const char *szName, int priority, ThreadFunc func, void *arg)
+{
+	Start s = { func, arg };
+	/* the kernel copies the argument block onto the new thread's stack */
+	*thread = sceKernelCreateThread(szName, trampoline, priority, THREAD_STACK, 0, 0);
+	if (*thread < 0) return 0;
+	return sceKernelStartThread(*thread, sizeof(s), &s) >= 0;
+}
+
+void threadJoin(Thread *thread)
+{
+	sceKernelWaitThreadEnd(*thread, 0);
+	sceKernelDeleteThread(*thread);
+}
+
+int semaInit(Sema *sema, int count)
+{
+	*sema = sceKernelCreateSema("sema", 0, count, 0x7fffffff, 0);
+	return *sema >= 0;
+}
+
+void semaWait(Sema *sema)
+{
+	sceKernelWaitSema(*sema, 1, 0);
+}
+
+int semaWaitTimeout(Sema *sema, int usec)
+{
+	SceUInt timeout = usec;
+	return sceKernelWaitSema(*sema, 1, &timeout) >= 0;
+}
+
+int semaTryWait(Sema *sema)
+{
+	return sceKernelPollSema(*sema, 1) >= 0;
+}
+
+void semaSignal(Sema *sema)
+{
+	sceKernelSignalSema(*sema, 1);
+}
+
+void semaDestroy(Sema *sema)
+{
+	sceKernelDeleteSema(*sema);
+}
+
+#else
+
+static void *trampoline(void *arg)
+{
+	Start s = *(Start*) arg;
+	free(arg);
+	s.func(s.arg);
+	return NULL;
+}
+
+int threadStart(Thread *thread, const char *szName, int priority, ThreadFunc func, void *arg)
+{
+	Start *s = (Start*) malloc(sizeof(Start));
+	(void)szName;
+	(void)priority;
+	if (!s) return 0;
+	s->func = func;
+	s->arg = arg;
+	if (pthread_create(thread, NULL, trampoline, s))
+	{
+		free(s);
+		return 0;
+	}
+	return 1;
+}
+
+void threadJoin(Thread *thread)
+{
+	pthread_join(*thread, NULL);
+}
+
+int semaInit(Sema *sema, int count)
+{
+	return sem_init(sema, 0, count) == 0;
+}
+
+void semaWait(Sema *sema)
+{
+	while (sem_wait(sema))
+		;
+}
+
+int semaWaitTimeout(Sema *sema, int usec)
+{
+	struct timespec t;
+
+	/* sem_timedwait wants a point in time, and only on the realtime clock */
+	clock_gettime(CLOCK_REALTIME, &t);
+	t.tv_sec += usec / 1000000;
+	t.tv_nsec += (usec % 1000000) * 1000L;
+	if (t.tv_nsec >= 1000000000L)
+	{
+		t.tv_sec++;
+		t.tv_nsec -= 1000000000L;
+	}
+	while (sem_timedwait(sema, &t))
+		if (errno != EINTR) return 0;
+	return 1;
+}
+
+int semaTryWait(Sema *sema)
+{
+	return sem_trywait(sema) == 0;
+}
+
+void semaSignal(Sema *sema)
+{
+	sem_post(sema);
+}
+
+void semaDestroy(Sema *sema)
+{
+	sem_destroy(sema);
+}
+
+#endif
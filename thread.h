@@ -0,0 +1,47 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+/* Minimal threads and semaphores over the PSP kernel or POSIX, for the
+   modules that also build into host tools. */
+
+#ifdef __psp__
+#include <pspkernel.h>
+typedef SceUID Thread;
+typedef SceUID Sema;
+#else
+#include <pthread.h>
+#include <semaphore.h>
+typedef pthread_t Thread;
+typedef sem_t Sema;
+#endif
+
+typedef int (*ThreadFunc)(void *arg);
+
+/**
+ * @param priority - PSP thread priority, lower runs first; ignored on a host
+ *
+ * @return 1 on success, 0 on failure
+ */
+extern int threadStart(Thread *thread, const char *szName, int priority, ThreadFunc func, void *arg);
+
+extern void threadJoin(Thread *thread);
+
+extern int semaInit(Sema *sema, int count);
+
+extern void semaWait(Sema *sema);
+
+/**
+ * @return 1 if the semaphore was taken, 0 if usec microseconds passed first
+ */
+extern int semaWaitTimeout(Sema *sema, int usec);
+
+/**
+ * @return 1 if the semaphore was taken, 0 if it would have blocked
+ */
+extern int semaTryWait(Sema *sema);
+
+extern void semaSignal(Sema *sema);
+
+extern void semaDestroy(Sema *sema);
+
+#endif
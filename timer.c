@@ -0,0 +1,80 @@
+#ifdef __psp__
+#include <pspkernel.h>
+#else
+#include <time.h>
+#endif
+
+#include "timer.h"
+
+u64 timerNow()
+{
+#ifdef __psp__
+	return (u64)sceKernelGetSystemTimeWide() * 1000;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+void timerSleep(u64 ns)
+{
+#ifdef __psp__
+	sceKernelDelayThread((SceUInt)(ns / 1000));
+#else
+	struct timespec ts;
+	ts.tv_sec = ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+void pacerInit(FramePacer *pacer, u64 period)
+{
+	pacer->period = period;
+	pacer->lastFrame = timerNow();
+	pacer->deadline = pacer->lastFrame;
+	pacerResetStats(pacer);
+}
+
+void pacerResetStats(FramePacer *pacer)
+{
+	pacer->frameTime = pacer->period;
+	pacer->jitterMax = 0;
+	pacer->jitterSum = 0;
+	pacer->frames = 0;
+	pacer->resyncs = 0;
+}
+
+void pacerWait(FramePacer *pacer)
+{
+	u64 now = timerNow();
+	u64 deviation;
+
+	pacer->deadline += pacer->period;
+	if (now < pacer->deadline)
+	{
+		u64 slack = pacer->deadline - now;
+		if (slack > PACER_SPIN_NS)
+			timerSleep(slack - PACER_SPIN_NS);
+		while ((now = timerNow()) < pacer->deadline)
+			;
+	}
+	else if (now - pacer->deadline > pacer->period)
+	{
+		pacer->deadline = now;
+		pacer->resyncs++;
+	}
+
+	pacer->frameTime = now - pacer->lastFrame;
+	pacer->lastFrame = now;
+	deviation = pacer->frameTime > pacer->period ? pacer->frameTime - pacer->period : pacer->period - pacer->frameTime;
+	if (deviation > pacer->jitterMax) pacer->jitterMax = deviation;
+	pacer->jitterSum += deviation;
+	pacer->frames++;
+}
+
+u64 pacerJitter(const FramePacer *pacer)
+{
+	return pacer->frames ? pacer->jitterSum / pacer->frames : 0;
+}
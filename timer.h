@@ -0,0 +1,47 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <psptypes.h>
+
+/* how close to the deadline we stop sleeping and start spinning */
+#define PACER_SPIN_NS 500000
+
+typedef struct
+{
+	u64 period;      // nanoseconds per frame
+	u64 deadline;    // absolute time the current frame ends
+	u64 lastFrame;   // time the previous wait returned
+	u64 frameTime;   // measured length of the last frame
+	u64 jitterMax;   // largest |frameTime - period| since reset
+	u64 jitterSum;
+	u32 frames;
+	u32 resyncs;     // times we fell more than a frame behind
+} FramePacer;
+
+/**
+ * Read the monotonic clock.
+ *
+ * @return nanoseconds since an arbitrary fixed point
+ */
+extern u64 timerNow();
+
+extern void timerSleep(u64 ns);
+
+extern void pacerInit(FramePacer *pacer, u64 period);
+
+/**
+ * Wait for the end of the current frame. Sleeps through most of the slack
+ * and spins only for the last PACER_SPIN_NS. Deadlines advance by exactly
+ * one period so rounding errors do not accumulate; when we are more than a
+ * frame late the schedule is restarted from now instead of bursting.
+ */
+extern void pacerWait(FramePacer *pacer);
+
+extern void pacerResetStats(FramePacer *pacer);
+
+/**
+ * @return mean absolute deviation of the frame time from the period, in ns
+ */
+extern u64 pacerJitter(const FramePacer *pacer);
+
+#endif
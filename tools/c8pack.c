@@ -0,0 +1,176 @@
+/* Build a ROM pack from loose ROM files.
+ *
+ *   cc -O2 -Itools -I. -o c8pack tools/c8pack.c rompack.c
+ *   c8pack out.c8p rom...
+ *   c8pack -l pack.c8p
+ *
+ * Each ROM is LZSS compressed when that makes it smaller, otherwise it is
+ * stored. Entries are named after the file name without its directory.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rompack.h"
+
+#define MAX_ROM (4096 - 0x200)
+
+static int compress(const u8 *in, int n, u8 *out)
+{
+	int pos = 0, len = 0, flagPos = 0, item = 8;
+
+	while (pos < n)
+	{
+		int best = 0, bestDist = 0, d;
+		if (item == 8)
+		{
+			flagPos = len++;
+			out[flagPos] = 0;
+			item = 0;
+		}
+		for (d = 1; d <= ROMPACK_WINDOW && d <= pos; d++)
+		{
+			int l = 0;
+			while (l < ROMPACK_MAX_MATCH && pos + l < n && in[pos + l] == in[pos + l - d])
+				l++;
+			if (l > best)
+			{
+				best = l;
+				bestDist = d;
+			}
+		}
+		if (best >= ROMPACK_MIN_MATCH)
+		{
+			int code = ((bestDist - 1) << 4) | (best - ROMPACK_MIN_MATCH);
+			out[len++] = code >> 8;
+			out[len++] = code & 0xff;
+			pos += best;
+		}
+		else
+		{
+			out[flagPos] |= 1 << item;
+			out[len++] = in[pos++];
+		}
+		item++;
+	}
+	return len;
+}
+
+static int list(const char *szPath)
+{
+	RomPack pack;
+	if (!rompackOpen(&pack, szPath))
+	{
+		fprintf(stderr, "%s: not a ROM pack\n", szPath);
+		return 1;
+	}
+	for (int i = 0; i < pack.count; i++)
+	{
+		RomPackEntry *e = &pack.entries[i];
+		printf("%-32s %5u %5u %s\n", e->name, (unsigned)e->size, (unsigned)e->packedSize,
+		       e->method == ROMPACK_LZSS ? "lzss" : "stored");
+	}
+	rompackClose(&pack);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	RomPackHeader hdr;
+	RomPackEntry *entries;
+	u8 rom[MAX_ROM], packed[MAX_ROM * 2], check[MAX_ROM];
+	FILE *out;
+	u32 offset;
+	int i, count = argc - 2;
+
+	if (argc == 3 && !strcmp(argv[1], "-l"))
+		return list(argv[2]);
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: c8pack out.c8p rom...\n       c8pack -l pack.c8p\n");
+		return 2;
+	}
+
+	entries = calloc(count, sizeof(RomPackEntry));
+	if (!(out = fopen(argv[1], "wb")))
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	hdr.magic = ROMPACK_MAGIC;
+	hdr.version = ROMPACK_VERSION;
+	hdr.count = count;
+	hdr.entrySize = sizeof(RomPackEntry);
+	offset = sizeof(hdr) + count * sizeof(RomPackEntry);
+	/* data first, the index is written once all offsets are known */
+	fseek(out, offset, SEEK_SET);
+
+	for (i = 0; i < count; i++)
+	{
+		const char *name = strrchr(argv[i + 2], '/');
+		RomPackEntry *e = &entries[i];
+		FILE *f = fopen(argv[i + 2], "rb");
+		int n, p;
+
+		if (!f)
+		{
+			perror(argv[i + 2]);
+			return 1;
+		}
+		n = fread(rom, 1, MAX_ROM, f);
+		fclose(f);
+
+		name = name ? name + 1 : argv[i + 2];
+		if (strlen(name) >= ROMPACK_NAME)
+		{
+			fprintf(stderr, "%s: name too long\n", name);
+			return 1;
+		}
+		strcpy(e->name, name);
+		e->offset = offset;
+		e->size = n;
+		p = compress(rom, n, packed);
+		if (p < n)
+		{
+			e->method = ROMPACK_LZSS;
+			e->packedSize = p;
+			fwrite(packed, 1, p, out);
+		}
+		else
+		{
+			e->method = ROMPACK_STORED;
+			e->packedSize = n;
+			fwrite(rom, 1, n, out);
+		}
+		offset += e->packedSize;
+	}
+	fseek(out, 0, SEEK_SET);
+	fwrite(&hdr, sizeof(hdr), 1, out);
+	fwrite(entries, sizeof(RomPackEntry), count, out);
+	if (fclose(out))
+	{
+		perror(argv[1]);
+		return 1;
+	}
+
+	/* read everything back through the loader */
+	{
+		RomPack pack;
+		if (!rompackOpen(&pack, argv[1]))
+			return 1;
+		for (i = 0; i < count; i++)
+		{
+			FILE *f = fopen(argv[i + 2], "rb");
+			int n = fread(rom, 1, MAX_ROM, f);
+			fclose(f);
+			if (rompackLoad(&pack, i, check, MAX_ROM) != n || memcmp(rom, check, n))
+			{
+				fprintf(stderr, "%s: verification failed\n", entries[i].name);
+				return 1;
+			}
+		}
+		rompackClose(&pack);
+	}
+	printf("%s: %d ROMs, %u bytes\n", argv[1], count, (unsigned)offset);
+	return 0;
+}
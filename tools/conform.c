@@ -0,0 +1,380 @@
+/* Conformance runner: run every test in a catalogue and compare the
+ * machine state at checkpoints with stored goldens. Tests are spread over
+ * forked workers, one per core by default.
+ *
+ *   cc -O2 -Itools -I. -o conform tools/conform.c CHIP8.c
+ *   cc -O2 -DCHIP8_SUPER -Itools -I. -o conform-super tools/conform.c CHIP8.c
+ *   conform [-j jobs] [-u] [-v] [-g golden] [catalogue]
+ *
+ * The catalogue (tools/conform.txt by default) has one test per line: a
+ * name followed by key=value fields.
+ *
+ *   rom=path        ROM to load, relative to the catalogue
+ *   code=hex,...    or the program inline; a segment may start with
+ *                   "addr:" to load it elsewhere than 0x200
+ *   frames=n        frames to run (default 600)
+ *   check=a,b,...   frames to record (default the last one)
+ *   iperiod=n       opcodes per frame (default 15)
+ *   quirks=n        chip8_quirks
+ *   seed=n          random number generator seed
+ *   keys=f:k+,...   press (+) or release (-) hex key k at frame f
+ *   auto=n          also toggle random keys, from a generator seeded by n
+ *   super=1         only run in CHIP8_SUPER builds
+ *
+ * Each checkpoint records hashes of the display and memory and all the
+ * registers. The goldens live next to the catalogue, conform.golden or
+ * conform-super.golden for the SCHIP build; -u rewrites them from the
+ * current core instead of comparing.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "CHIP8.h"
+
+#define MAX_TESTS 256
+#define MAX_CHECKS 16
+#define MAX_EVENTS 64
+#define LINE_SIZE 160
+
+typedef struct
+{
+	char name[32];
+	char rom[256];
+	char code[1024];
+	unsigned frames, iperiod, quirks, seed, autoSeed;
+	int super;
+	unsigned checks[MAX_CHECKS];
+	int numChecks;
+	struct { unsigned frame; int key, down; } events[MAX_EVENTS];
+	int numEvents;
+} Test;
+
+static Test tests[MAX_TESTS];
+static int numTests;
+typedef char Lines[MAX_TESTS][MAX_CHECKS][LINE_SIZE];
+static Lines results, goldens;
+
+void chip8_sound_on (void) { }
+void chip8_sound_off (void) { }
+void chip8_interrupt (void) { }
+
+static unsigned long long hashBytes(const byte *p, size_t n)
+{
+	unsigned long long h = 0xcbf29ce484222325ULL;
+	while (n--)
+		h = (h ^ *p++) * 0x100000001b3ULL;
+	return h;
+}
+
+static int parseList(const char *s, unsigned *out, int max)
+{
+	int n = 0;
+	while (*s && n < max)
+	{
+		out[n++] = strtoul(s, (char**)&s, 0);
+		if (*s != ',') break;
+		s++;
+	}
+	return n;
+}
+
+static int parseTest(Test *t, char *line)
+{
+	char *field = strtok(line, " \t\r\n");
+
+	if (!field || field[0] == '#') return 0;
+	memset(t, 0, sizeof(*t));
+	snprintf(t->name, sizeof(t->name), "%s", field);
+	t->frames = 600;
+	t->iperiod = 15;
+	t->seed = 1;
+	while ((field = strtok(NULL, " \t\r\n")))
+	{
+		char *value = strchr(field, '=');
+		if (!value) return -1;
+		*value++ = 0;
+		if (!strcmp(field, "rom")) snprintf(t->rom, sizeof(t->rom), "%s", value);
+		else if (!strcmp(field, "code")) snprintf(t->code, sizeof(t->code), "%s", value);
+		else if (!strcmp(field, "frames")) t->frames = strtoul(value, NULL, 0);
+		else if (!strcmp(field, "iperiod")) t->iperiod = strtoul(value, NULL, 0);
+		else if (!strcmp(field, "quirks")) t->quirks = strtoul(value, NULL, 0);
+		else if (!strcmp(field, "seed")) t->seed = strtoul(value, NULL, 0);
+		else if (!strcmp(field, "auto")) t->autoSeed = strtoul(value, NULL, 0);
+		else if (!strcmp(field, "super")) t->super = atoi(value);
+		else if (!strcmp(field, "check")) t->numChecks = parseList(value, t->checks, MAX_CHECKS);
+		else if (!strcmp(field, "keys"))
+		{
+			char *p = value;
+			while (*p && t->numEvents < MAX_EVENTS)
+			{
+				unsigned f;
+				int key, used;
+				char state;
+				if (sscanf(p, "%u:%x%c%n", &f, &key, &state, &used) != 3) return -1;
+				t->events[t->numEvents].frame = f;
+				t->events[t->numEvents].key = key & 15;
+				t->events[t->numEvents].down = state == '+';
+				t->numEvents++;
+				p += used;
+				if (*p == ',') p++;
+			}
+		}
+		else return -1;
+	}
+	if (!t->numChecks)
+		t->checks[t->numChecks++] = t->frames;
+	return 1;
+}
+
+static int readCatalogue(const char *szPath)
+{
+	char line[2048];
+	int lineNo = 0, r;
+	FILE *file = fopen(szPath, "r");
+
+	if (!file) return 0;
+	while (fgets(line, sizeof(line), file) && numTests < MAX_TESTS)
+	{
+		lineNo++;
+		if ((r = parseTest(&tests[numTests], line)) < 0)
+		{
+			fprintf(stderr, "%s:%d: bad test\n", szPath, lineNo);
+			fclose(file);
+			return 0;
+		}
+#ifndef CHIP8_SUPER
+		if (r && tests[numTests].super) continue;
+#endif
+		numTests += r;
+	}
+	fclose(file);
+	return 1;
+}
+
+static int loadProgram(const Test *t, const char *szDir)
+{
+	if (t->rom[0])
+	{
+		char path[512];
+		FILE *file;
+		int n;
+		snprintf(path, sizeof(path), "%s/%s", szDir, t->rom);
+		if (!(file = fopen(path, "rb"))) return 0;
+		n = fread(chip8_mem + 0x200, 1, 4096 - 0x200, file);
+		fclose(file);
+		return n > 0;
+	}
+	else
+	{
+		const char *p = t->code;
+		unsigned addr = 0x200;
+		while (*p)
+		{
+			const char *colon = strchr(p, ':'), *comma = strchr(p, ',');
+			if (colon && (!comma || colon < comma))
+			{
+				addr = strtoul(p, NULL, 16);
+				p = colon + 1;
+			}
+			for (; p[0] && p[1] && p[0] != ','; p += 2, addr++)
+			{
+				unsigned b;
+				if (sscanf(p, "%2x", &b) != 1) return 0;
+				chip8_mem[addr & 4095] = b;
+			}
+			if (*p == ',') p++;
+		}
+		return 1;
+	}
+}
+
+static void runTest(const Test *t, const char *szDir, FILE *out)
+{
+	unsigned frame, rng = t->autoSeed;
+	int check = 0, i;
+
+	chip8_iperiod = t->iperiod;
+	chip8_quirks = t->quirks;
+	/* workers run several tests, so nothing may leak from the last one */
+	memset(chip8_mem, 0, sizeof(chip8_mem));
+	chip8_reset();
+	chip8_rng = t->seed;
+	if (!loadProgram(t, szDir))
+	{
+		fprintf(out, "%s 0 cannot load\n", t->name);
+		return;
+	}
+	for (frame = 1; frame <= t->frames && check < t->numChecks; frame++)
+	{
+		for (i = 0; i < t->numEvents; i++)
+			if (t->events[i].frame == frame)
+				chip8_key(t->events[i].key, t->events[i].down);
+		if (t->autoSeed)
+		{
+			rng = rng * 1103515245 + 12345;
+			if (((rng >> 16) & 7) == 0)
+				chip8_keys ^= 1 << ((rng >> 20) & 15);
+		}
+		chip8_frame();
+		if (frame == t->checks[check])
+		{
+			fprintf(out, "%s %u %016llx %016llx ", t->name, frame,
+			        hashBytes(chip8_display, sizeof(chip8_display)), hashBytes(chip8_mem, sizeof(chip8_mem)));
+			for (i = 0; i < 16; i++)
+				fprintf(out, "%02x", chip8_regs.alg[i]);
+			fprintf(out, " %03x %03x %03x %02x %02x %d\n", chip8_regs.i, chip8_regs.pc, chip8_regs.sp,
+			        chip8_regs.delay, chip8_regs.sound, chip8_running);
+			check++;
+		}
+	}
+}
+
+/* store a result line under its test and checkpoint */
+static void collect(Lines lines, const char *line)
+{
+	char name[32];
+	unsigned frame;
+	int t, c;
+
+	if (sscanf(line, "%31s %u", name, &frame) != 2) return;
+	for (t = 0; t < numTests; t++)
+		if (!strcmp(tests[t].name, name))
+			for (c = 0; c < tests[t].numChecks; c++)
+				if (tests[t].checks[c] == frame || (frame == 0 && c == 0))
+				{
+					snprintf(lines[t][c], LINE_SIZE, "%s", line);
+					return;
+				}
+}
+
+int main(int argc, char **argv)
+{
+	const char *szCatalogue = "tools/conform.txt", *szGolden = NULL;
+	char szDir[512], szDefaultGolden[512], line[LINE_SIZE];
+	int jobs = sysconf(_SC_NPROCESSORS_ONLN), update = 0, verbose = 0;
+	int opt, w, t, c, checks = 0, failures = 0;
+	struct timespec t0, t1;
+	FILE *file;
+	char *slash;
+
+	while ((opt = getopt(argc, argv, "j:uvg:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'j': jobs = atoi(optarg); break;
+		case 'u': update = 1; break;
+		case 'v': verbose = 1; break;
+		case 'g': szGolden = optarg; break;
+		default:
+			fprintf(stderr, "usage: conform [-j jobs] [-u] [-v] [-g golden] [catalogue]\n");
+			return 2;
+		}
+	}
+	if (optind < argc) szCatalogue = argv[optind];
+	if (!readCatalogue(szCatalogue))
+	{
+		perror(szCatalogue);
+		return 2;
+	}
+	snprintf(szDir, sizeof(szDir), "%s", szCatalogue);
+	if ((slash = strrchr(szDir, '/'))) *slash = 0;
+	else strcpy(szDir, ".");
+	if (!szGolden)
+	{
+#ifdef CHIP8_SUPER
+		snprintf(szDefaultGolden, sizeof(szDefaultGolden), "%s/conform-super.golden", szDir);
+#else
+		snprintf(szDefaultGolden, sizeof(szDefaultGolden), "%s/conform.golden", szDir);
+#endif
+		szGolden = szDefaultGolden;
+	}
+	if (jobs < 1) jobs = 1;
+	if (jobs > numTests) jobs = numTests;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	{
+		FILE *pipes[jobs];
+		pid_t pids[jobs];
+		for (w = 0; w < jobs; w++)
+		{
+			int fd[2];
+			if (pipe(fd) < 0 || (pids[w] = fork()) < 0)
+			{
+				perror("conform");
+				return 2;
+			}
+			if (!pids[w])
+			{
+				FILE *out = fdopen(fd[1], "w");
+				close(fd[0]);
+				for (t = w; t < numTests; t += jobs)
+					runTest(&tests[t], szDir, out);
+				fclose(out);
+				_exit(0);
+			}
+			close(fd[1]);
+			pipes[w] = fdopen(fd[0], "r");
+		}
+		for (w = 0; w < jobs; w++)
+		{
+			while (fgets(line, sizeof(line), pipes[w]))
+			{
+				line[strcspn(line, "\n")] = 0;
+				collect(results, line);
+			}
+			fclose(pipes[w]);
+			waitpid(pids[w], NULL, 0);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if (update)
+	{
+		if (!(file = fopen(szGolden, "w")))
+		{
+			perror(szGolden);
+			return 2;
+		}
+		for (t = 0; t < numTests; t++)
+			for (c = 0; c < tests[t].numChecks; c++)
+				fprintf(file, "%s\n", results[t][c]);
+		fclose(file);
+		printf("wrote %s\n", szGolden);
+		return 0;
+	}
+
+	if (!(file = fopen(szGolden, "r")))
+	{
+		perror(szGolden);
+		return 2;
+	}
+	while (fgets(line, sizeof(line), file))
+	{
+		line[strcspn(line, "\n")] = 0;
+		collect(goldens, line);
+	}
+	fclose(file);
+	for (t = 0; t < numTests; t++)
+		for (c = 0; c < tests[t].numChecks; c++, checks++)
+		{
+			if (!goldens[t][c][0])
+			{
+				printf("NEW  %s\n", results[t][c]);
+				failures++;
+			}
+			else if (strcmp(results[t][c], goldens[t][c]))
+			{
+				printf("FAIL %s\n     expected %s\n", results[t][c], goldens[t][c]);
+				failures++;
+			}
+			else if (verbose)
+				printf("ok   %s\n", results[t][c]);
+		}
+	printf("%d tests, %d checkpoints, %d failed, %d jobs, %.3f s\n", numTests, checks, failures, jobs,
+	       (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+	return failures != 0;
+}
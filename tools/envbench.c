@@ -0,0 +1,213 @@
+/* Step a batch of machines through env.c and check them against the core.
+ *
+ *   cc -O2 -pthread -DCHIP8_THREADS -Itools -I. -o envbench tools/envbench.c env.c thread.c CHIP8.c
+ *   envbench [-n machines] [-j threads] [-t steps] [-s frameskip] [-i iperiod] [-q quirks]
+ *            [-r seed] [-a score] [-D digits] [-c check] rom
+ *
+ * Every machine gets its own random number seed and its own random key
+ * presses, a new one each step. The steps are timed; then the first -c
+ * machines are run again on their own with chip8_frame and must end with
+ * the same memory, registers and display, and with the same total reward
+ * when -a names the address of the score (-D BCD digits, 0 for a byte).
+ * Finally the first and the last machine are reset again, on the worker
+ * that ran them and on this thread, and must come out as they did at
+ * first; a worker's core must not keep anything from the machine it ran
+ * before.
+ *
+ * The time it takes to copy a machine into the core and back, once per
+ * machine and step, is reported against the time of a step.
+ *
+ *   PONG  -a 0x2f3 -D 1    left player's points
+ *   BRIX  -a 0x314 -D 3
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "CHIP8.h"
+#include "env.h"
+
+void chip8_sound_on (void) { }
+void chip8_sound_off (void) { }
+void chip8_interrupt (void) { }
+
+static unsigned seed = 1;
+
+/* the keys machine n holds in step t */
+static u16 action(int n, int t)
+{
+	unsigned x = seed * 0x9e3779b9u ^ n * 0x85ebca6bu ^ t * 0xc2b2ae35u;
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	return x & 16 ? 1 << (x >> 8 & 15) : 0;
+}
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int sameState(const struct chip8_state *a, const struct chip8_state *b)
+{
+	return !memcmp(&a->regs, &b->regs, sizeof(a->regs)) && a->rng == b->rng &&
+	       a->keys == b->keys && a->key_pressed == b->key_pressed && a->super == b->super &&
+	       a->running == b->running && !memcmp(a->mem, b->mem, sizeof(a->mem)) &&
+	       !memcmp(a->display, b->display, sizeof(a->display));
+}
+
+int main(int argc, char **argv)
+{
+	int machines = 256, threads = 4, steps = 1000, frameskip = 4, check = 8;
+	int opt, n, t, f, size, resets, bad = 0;
+	u8 iperiod = 15, quirks = 0;
+	u8 rom[4096 - 0x200];
+	EnvScore score = { 0, 0 };
+	u32 *seeds, memo;
+	u16 *actions;
+	float *total, expect;
+	double elapsed, copy;
+	struct chip8_state state, *initial;
+	Env env;
+	FILE *file;
+
+	while ((opt = getopt(argc, argv, "n:j:t:s:i:q:r:a:D:c:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': machines = atoi(optarg); break;
+		case 'j': threads = atoi(optarg); break;
+		case 't': steps = atoi(optarg); break;
+		case 's': frameskip = atoi(optarg); break;
+		case 'i': iperiod = atoi(optarg); break;
+		case 'q': quirks = strtoul(optarg, NULL, 0); break;
+		case 'r': seed = strtoul(optarg, NULL, 0); break;
+		case 'a': score.addr = strtoul(optarg, NULL, 0); break;
+		case 'D': score.digits = atoi(optarg); break;
+		case 'c': check = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: envbench [-n machines] [-j threads] [-t steps] [-s frameskip] [-i iperiod] [-q quirks]\n"
+			                "                [-r seed] [-a score] [-D digits] [-c check] rom\n");
+			return 2;
+		}
+	}
+	if (optind >= argc || machines < 1 || steps < 1 || frameskip < 1 || iperiod < 1)
+	{
+		fprintf(stderr, "envbench: need a ROM, machines, steps and frameskip\n");
+		return 2;
+	}
+	if (!(file = fopen(argv[optind], "rb")))
+	{
+		fprintf(stderr, "envbench: cannot open %s\n", argv[optind]);
+		return 1;
+	}
+	size = fread(rom, 1, sizeof(rom), file);
+	fclose(file);
+	if (size <= 0 || !envInit(&env, machines, threads, rom, size, iperiod, quirks))
+	{
+		fprintf(stderr, "envbench: cannot set up %d machines\n", machines);
+		return 1;
+	}
+	if (score.addr)
+		envSetReward(&env, envScoreReward, &score);
+
+	seeds = malloc(machines * sizeof(*seeds));
+	actions = malloc(machines * sizeof(*actions));
+	total = calloc(machines, sizeof(*total));
+	for (n = 0; n < machines; n++)
+		seeds[n] = seed + n;
+	envReset(&env, seeds);
+	initial = malloc(2 * sizeof(*initial));
+	initial[0] = env.state[0];
+	initial[1] = env.state[machines - 1];
+
+	elapsed = 0;
+	for (t = 0; t < steps; t++)
+	{
+		double start;
+		for (n = 0; n < machines; n++)
+			actions[n] = action(n, t);
+		start = now();
+		envStep(&env, actions, frameskip);
+		elapsed += now() - start;
+		for (n = 0; n < machines; n++)
+			total[n] += env.reward[n];
+	}
+	printf("%d machines, %d threads, %d steps of %d frames: %.0f frames/s, %.0f steps/s\n",
+	       machines, env.threads, steps, frameskip, env.frames / elapsed, steps * machines / elapsed);
+
+	/* what envStep spends on moving machines in and out of the core */
+	copy = now();
+	for (t = 0; t < 100; t++)
+		for (n = 0; n < machines; n++)
+		{
+			chip8_load_state(&env.state[n]);
+			chip8_save_state(&env.state[n]);
+		}
+	copy = (now() - copy) / (100.0 * machines);
+	printf("state copy: %u bytes, %.0f ns per machine and step, %.1f%% of a step on one thread\n",
+	       (unsigned)(2 * (sizeof(chip8_mem) + sizeof(chip8_display))), copy * 1e9,
+	       copy * 100 * steps * machines / (elapsed * (env.threads ? env.threads : 1)));
+
+	/* the same machines, one at a time on this thread's core */
+	if (check > machines) check = machines;
+	for (n = 0; n < check; n++)
+	{
+		chip8_iperiod = iperiod;
+		chip8_quirks = quirks;
+		chip8_run_mask = 0;
+		memset(chip8_mem, 0, sizeof(chip8_mem));
+		chip8_reset();
+		memcpy(chip8_mem + 0x200, rom, size);
+		chip8_rng = seeds[n];
+		memo = 0;
+		chip8_save_state(&state);
+		if (score.addr) envScoreReward(&state, &memo, &score);
+		expect = 0;
+		for (t = 0; t < steps && chip8_running == 1; t++)
+		{
+			chip8_keys = action(n, t);
+			for (f = 0; f < frameskip && chip8_running == 1; f++)
+				chip8_frame();
+			chip8_save_state(&state);
+			if (score.addr) expect += envScoreReward(&state, &memo, &score);
+		}
+		if (memcmp(chip8_mem, env.state[n].mem, sizeof(chip8_mem)) ||
+		    memcmp(&chip8_regs, &env.state[n].regs, sizeof(chip8_regs)) ||
+		    memcmp(chip8_display, envObservation(&env, n), sizeof(chip8_display)) ||
+		    expect != total[n])
+		{
+			printf("machine %d differs from the core (reward %g, expected %g)\n", n, total[n], expect);
+			bad++;
+		}
+	}
+	if (check)
+		printf("%d of %d machines checked: %s\n", check, machines, bad ? "FAILED" : "ok");
+
+	/* the workers and this core all ran other machines since */
+	envReset(&env, seeds);
+	resets = !sameState(&env.state[0], &initial[0]) || !sameState(&env.state[machines - 1], &initial[1]);
+	envResetOne(&env, 0, seeds[0]);
+	envResetOne(&env, machines - 1, seeds[machines - 1]);
+	resets |= (!sameState(&env.state[0], &initial[0]) || !sameState(&env.state[machines - 1], &initial[1])) << 1;
+	printf("reset on the workers: %s, on this thread: %s\n", resets & 1 ? "FAILED" : "ok", resets & 2 ? "FAILED" : "ok");
+	bad += resets != 0;
+	if (score.addr)
+	{
+		float sum = 0;
+		for (n = 0; n < machines; n++)
+			sum += total[n];
+		printf("mean reward %.3f\n", sum / machines);
+	}
+
+	free(seeds);
+	free(actions);
+	free(total);
+	free(initial);
+	envFree(&env);
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+/* Grow a random game tree with chip8_fork and check it against full
+ * state copies.
+ *
+ *   cc -O2 -DCHIP8_COW [-DCHIP8_HASH] -Itools -I. -o forkbench tools/forkbench.c CHIP8.c
+ *   forkbench [-n nodes] [-f frames] [-p pool] [-r seed] rom
+ *
+ * Each step resumes a random node of the pool, runs a few frames with a
+ * random key held and forks the result back into the pool in place of
+ * another random node. Every resume is compared with a chip8_save_state
+ * copy taken when the node was forked. Prints the time per fork and
+ * resume against chip8_save_state and chip8_load_state, and how many
+ * pages the pool holds against what full copies would take. Built with
+ * CHIP8_HASH it also checks chip8_hash after every resume.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "CHIP8.h"
+
+void chip8_sound_on (void) { }
+void chip8_sound_off (void) { }
+void chip8_interrupt (void) { }
+
+typedef struct
+{
+	struct chip8_fork *fork;
+	struct chip8_state copy;
+#ifdef CHIP8_HASH
+	unsigned long long hash;
+#endif
+} Node;
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int comparePointers(const void *a, const void *b)
+{
+	const void *x = *(const void * const *)a, *y = *(const void * const *)b;
+	return x < y ? -1 : x > y;
+}
+
+static int sameState(const struct chip8_state *a, const struct chip8_state *b)
+{
+	return !memcmp(&a->regs, &b->regs, sizeof(a->regs)) && a->rng == b->rng &&
+	       a->keys == b->keys && a->key_pressed == b->key_pressed &&
+	       a->super == b->super && a->running == b->running &&
+	       !memcmp(a->mem, b->mem, sizeof(a->mem)) && !memcmp(a->display, b->display, sizeof(a->display));
+}
+
+int main(int argc, char **argv)
+{
+	int nodes = 20000, frames = 4, poolSize = 256, opt, n, i, bad = 0, unique;
+	unsigned seed = 1;
+	double forkTime = 0, resumeTime = 0, t;
+	struct chip8_state check;
+	struct chip8_page **pages;
+	Node *pool;
+	FILE *file;
+
+	chip8_iperiod = 15;
+	while ((opt = getopt(argc, argv, "n:f:p:r:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': nodes = atoi(optarg); break;
+		case 'f': frames = atoi(optarg); break;
+		case 'p': poolSize = atoi(optarg); break;
+		case 'r': seed = strtoul(optarg, NULL, 0); break;
+		default:
+			fprintf(stderr, "usage: forkbench [-n nodes] [-f frames] [-p pool] [-r seed] rom\n");
+			return 2;
+		}
+	}
+	if (optind >= argc || !(file = fopen(argv[optind], "rb")))
+	{
+		fprintf(stderr, "forkbench: cannot open ROM\n");
+		return 1;
+	}
+	if (poolSize < 1) poolSize = 1;
+	srand(seed);
+	chip8_reset();
+	n = fread(chip8_mem + 0x200, 1, 4096 - 0x200, file);
+	fclose(file);
+	if (n <= 0) return 1;
+#ifdef CHIP8_HASH
+	chip8_rehash();
+#endif
+
+	pool = calloc(poolSize, sizeof(Node));
+	for (i = 0; i < poolSize; i++)
+	{
+		pool[i].fork = chip8_fork();
+		chip8_save_state(&pool[i].copy);
+#ifdef CHIP8_HASH
+		pool[i].hash = chip8_hash();
+#endif
+	}
+
+	for (n = 0; n < nodes; n++)
+	{
+		Node *from = &pool[rand() % poolSize], *to = &pool[rand() % poolSize];
+		int key = rand() % 17;
+
+		t = now();
+		chip8_resume_fork(from->fork);
+		resumeTime += now() - t;
+		chip8_save_state(&check);
+		if (!sameState(&check, &from->copy))
+		{
+			printf("node %d differs after resume\n", n);
+			bad++;
+		}
+#ifdef CHIP8_HASH
+		if (chip8_hash() != from->hash)
+		{
+			printf("node %d hash differs after resume\n", n);
+			bad++;
+		}
+#endif
+
+		chip8_keys = key < 16 ? 1 << key : 0;
+		for (i = 0; i < frames; i++)
+			chip8_frame();
+
+		chip8_free_fork(to->fork);
+		t = now();
+		to->fork = chip8_fork();
+		forkTime += now() - t;
+		chip8_save_state(&to->copy);
+#ifdef CHIP8_HASH
+		to->hash = chip8_hash();
+#endif
+	}
+
+	/* the same number of full copies for comparison */
+	t = now();
+	for (n = 0; n < nodes; n++)
+		chip8_save_state(&pool[n % poolSize].copy);
+	for (n = 0; n < nodes; n++)
+		chip8_load_state(&pool[n % poolSize].copy);
+	t = now() - t;
+
+	pages = malloc(poolSize * CHIP8_PAGES * sizeof(*pages));
+	for (i = 0; i < poolSize; i++)
+		memcpy(pages + i * CHIP8_PAGES, pool[i].fork->page, sizeof(pool[i].fork->page));
+	qsort(pages, poolSize * CHIP8_PAGES, sizeof(*pages), comparePointers);
+	for (unique = 1, i = 1; i < poolSize * CHIP8_PAGES; i++)
+		unique += pages[i] != pages[i - 1];
+
+	printf("%d nodes: fork %.0f ns, resume %.0f ns, save+load %.0f ns\n", nodes,
+	       forkTime / nodes * 1e9, resumeTime / nodes * 1e9, t / nodes * 1e9);
+	printf("pool of %d holds %d pages (%d KB), full copies %d KB\n", poolSize, unique,
+	       unique * CHIP8_PAGE / 1024, (int)(poolSize * sizeof(struct chip8_state) / 1024));
+
+	for (i = 0; i < poolSize; i++)
+		chip8_free_fork(pool[i].fork);
+	free(pages);
+	free(pool);
+	return bad ? 1 : 0;
+}
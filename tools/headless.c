@@ -0,0 +1,243 @@
+/* Run a ROM without a PSP, as fast as the host allows.
+ *
+ *   cc -O2 -pthread -Itools -I. -o headless tools/headless.c CHIP8.c capture.c thread.c gdbstub.c shmexport.c -lrt
+ *   headless [-n frames] [-i iperiod] [-r seed] [-k keys.txt] [-c out.raw | -y out.y4m] [-a]
+ *            [-b addr[:vX<op>value]]... [-w addr[+len][r|w]]... [-g port] [-x name [-m addr+len]...] rom
+ *
+ * keys.txt lists scripted input, one "<frame> <key> <down|up>" per line
+ * with the key in hex. -a disables duplicate-frame elision when capturing.
+ * -b sets a breakpoint, optionally only when register X compares with the
+ * value (op is one of = ! < >=), and -w watches memory; the registers are
+ * printed at every stop. Addresses and values are hex.
+ * -g waits for a GDB remote protocol connection before the first opcode
+ * and then runs without a frame limit unless -n is given.
+ * -x publishes every frame to the shared memory object name, e.g. /chip8,
+ * with the memory ranges given by -m; see shmexport.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "CHIP8.h"
+#include "capture.h"
+#include "gdbstub.h"
+#include "shmexport.h"
+
+typedef struct
+{
+	unsigned frame;
+	int key, down;
+} KeyEvent;
+
+static KeyEvent *script;
+static int numEvents, nextEvent;
+static unsigned frame, frames = 3000;
+static int debugger;
+
+void chip8_sound_on (void) { }
+void chip8_sound_off (void) { }
+
+void chip8_interrupt (void)
+{
+	if (captureActive())
+		captureFrame(chip8_display);
+	if (debugger)
+		gdbstubFrame();
+	if (shmExportActive())
+		shmExportFrame();
+	frame++;
+	while (nextEvent < numEvents && script[nextEvent].frame <= frame)
+	{
+		chip8_key(script[nextEvent].key, script[nextEvent].down);
+		nextEvent++;
+	}
+	if (frame >= frames)
+		chip8_running = 0;
+}
+
+static int parseBreak(const char *arg)
+{
+	unsigned addr, reg, value;
+	char op[3];
+
+	if (sscanf(arg, "%x:v%1x%2[=!<>]%x", &addr, &reg, op, &value) == 4)
+	{
+		int cond = !strcmp(op, "=") ? CHIP8_COND_EQ : !strcmp(op, "!") ? CHIP8_COND_NE :
+		           !strcmp(op, "<") ? CHIP8_COND_LT : !strcmp(op, ">=") ? CHIP8_COND_GE : -1;
+		return cond >= 0 && chip8_set_condition(addr, reg, cond, value);
+	}
+	if (sscanf(arg, "%x", &addr) != 1) return 0;
+	chip8_set_breakpoint(addr, 1);
+	return 1;
+}
+
+static int parseWatch(const char *arg)
+{
+	unsigned addr, len = 1;
+	const char *end = arg + strlen(arg);
+	int flags = CHIP8_WATCH_READ | CHIP8_WATCH_WRITE;
+
+	if (end > arg && (end[-1] == 'r' || end[-1] == 'w'))
+		flags = end[-1] == 'r' ? CHIP8_WATCH_READ : CHIP8_WATCH_WRITE;
+	if (sscanf(arg, "%x+%x", &addr, &len) < 1) return 0;
+	chip8_set_watchpoint(addr, len, flags);
+	return 1;
+}
+
+static void reportStop(void)
+{
+	static const char *reasons[] = { "stop", "break", "read", "write", "step" };
+	int i;
+
+	printf("frame %u: %s at %03x, pc %03x i %03x sp %03x v", frame,
+	       reasons[chip8_stop_reason <= CHIP8_STOP_STEP ? chip8_stop_reason : 0], chip8_stop_addr, chip8_regs.pc, chip8_regs.i, chip8_regs.sp);
+	for (i = 0; i < 16; i++)
+		printf(" %02x", chip8_regs.alg[i]);
+	printf("\n");
+}
+
+static int readScript(const char *szPath)
+{
+	char line[128], state[8];
+	unsigned f;
+	int key, cap = 0;
+	FILE *file = fopen(szPath, "r");
+
+	if (!file) return 0;
+	while (fgets(line, sizeof(line), file))
+	{
+		if (line[0] == '#' || sscanf(line, "%u %x %7s", &f, &key, state) != 3) continue;
+		if (numEvents == cap)
+		{
+			cap = cap ? cap * 2 : 64;
+			script = realloc(script, cap * sizeof(KeyEvent));
+		}
+		script[numEvents].frame = f;
+		script[numEvents].key = key & 0x0f;
+		script[numEvents].down = !strcmp(state, "down");
+		numEvents++;
+	}
+	fclose(file);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *capturePath = NULL, *exportName = NULL;
+	ShmWindow windows[SHMEXPORT_WINDOWS];
+	unsigned addr, len;
+	int numWindows = 0;
+	int format = CAPTURE_RAW, elide = 1, opt, n, port = 0, limit = 0;
+	unsigned seed = 1;
+	struct timespec t0, t1;
+	FILE *file;
+
+	chip8_iperiod = 15;
+	while ((opt = getopt(argc, argv, "n:i:r:k:c:y:ab:w:g:x:m:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': frames = strtoul(optarg, NULL, 0); limit = 1; break;
+		case 'i': chip8_iperiod = atoi(optarg); break;
+		case 'r': seed = strtoul(optarg, NULL, 0); break;
+		case 'k':
+			if (!readScript(optarg)) { perror(optarg); return 1; }
+			break;
+		case 'c': capturePath = optarg; format = CAPTURE_RAW; break;
+		case 'y': capturePath = optarg; format = CAPTURE_Y4M; break;
+		case 'a': elide = 0; break;
+		case 'b':
+			if (!parseBreak(optarg)) { fprintf(stderr, "headless: bad breakpoint %s\n", optarg); return 2; }
+			break;
+		case 'w':
+			if (!parseWatch(optarg)) { fprintf(stderr, "headless: bad watch %s\n", optarg); return 2; }
+			break;
+		case 'g': port = atoi(optarg); break;
+		case 'x': exportName = optarg; break;
+		case 'm':
+			if (numWindows == SHMEXPORT_WINDOWS || sscanf(optarg, "%x+%x", &addr, &len) != 2)
+			{
+				fprintf(stderr, "headless: bad memory window %s\n", optarg);
+				return 2;
+			}
+			windows[numWindows].addr = addr;
+			windows[numWindows].size = len;
+			numWindows++;
+			break;
+		default:
+			fprintf(stderr, "usage: headless [-n frames] [-i iperiod] [-r seed] [-k keys.txt] [-c out.raw | -y out.y4m] [-a]\n"
+			                "                [-b addr[:vX<op>value]]... [-w addr[+len][r|w]]... [-g port]\n"
+			                "                [-x name [-m addr+len]...] rom\n");
+			return 2;
+		}
+	}
+	if (optind >= argc || !(file = fopen(argv[optind], "rb")))
+	{
+		fprintf(stderr, "headless: cannot open ROM\n");
+		return 1;
+	}
+	n = fread(chip8_mem + 0x200, 1, 4096 - 0x200, file);
+	fclose(file);
+	if (n <= 0) return 1;
+
+	if (capturePath && !captureOpen(capturePath, format, CHIP8_WIDTH, CHIP8_HEIGHT, 50, elide))
+	{
+		perror(capturePath);
+		return 1;
+	}
+
+	if (exportName && !shmExportOpen(exportName, windows, numWindows))
+	{
+		fprintf(stderr, "headless: cannot export to %s\n", exportName);
+		return 1;
+	}
+
+	srand(seed);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (port)
+	{
+		if (!gdbstubOpen(port))
+		{
+			perror("headless");
+			return 1;
+		}
+		if (!limit) frames = ~0u;
+		debugger = 1;
+		printf("waiting for gdb on port %d\n", port);
+		fflush(stdout);
+		chip8_reset();
+		chip8_running = 2;
+		while (chip8_running == 2 && gdbstubStopped())
+			while (chip8_running == 1) chip8_execute();
+		gdbstubClose();
+	}
+	else
+	{
+		chip8();
+		while (chip8_running == 2)
+		{
+			reportStop();
+			chip8_running = 1;
+			while (chip8_running == 1) chip8_execute();
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	printf("%u frames in %.3f s (%.0f frames/s)\n", frame, secs, frame / secs);
+	if (capturePath)
+	{
+		CaptureStats stats;
+		if (!captureClose(&stats))
+		{
+			fprintf(stderr, "headless: writing %s failed, %u of %u kept frames lost\n", capturePath, stats.lost, stats.written);
+			shmExportClose();
+			return 1;
+		}
+		printf("captured %u of %u frames, %u stalls\n", stats.written, stats.frames, stats.stalls);
+	}
+	shmExportClose();
+	return chip8_running == 3;
+}
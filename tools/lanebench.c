@@ -0,0 +1,135 @@
+/* Run copies of a ROM in lockstep lanes and check them against the core.
+ *
+ *   cc -O2 -mavx2 -Itools -I. -o lanebench tools/lanebench.c lanes.c CHIP8.c
+ *   lanebench [-l lanes] [-n frames] [-i iperiod] [-q quirks] [-r seed] [-s] rom
+ *
+ * Every lane gets its own random key presses, or with -s all lanes share
+ * one sequence and differ only in their random number seed. Each machine
+ * is first run on its own with chip8_frame, then all of them together
+ * with lanesFrame; the final states must match. Without -mavx2 lanes.c falls back to a
+ * plain loop over the lanes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "CHIP8.h"
+#include "lanes.h"
+
+void chip8_sound_on (void) { }
+void chip8_sound_off (void) { }
+void chip8_interrupt (void) { }
+
+static int shared;
+
+/* the keys lane l holds on frame f */
+static u16 laneKeys(unsigned seed, int l, unsigned f)
+{
+	unsigned h = (seed ^ (shared ? 0 : l * 0x9e3779b9u)) + (f / 20) * 0x85ebca6bu;
+	h ^= h >> 15; h *= 0x2c1b3c6du; h ^= h >> 12;
+	return (h & 3) ? 0 : 1 << ((h >> 8) & 15);
+}
+
+static double seconds(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	int count = 16, opt, n, l, bad = 0;
+	unsigned frames = 3000, seed = 1, f;
+	struct chip8_state start, *scalar, lane;
+	struct timespec t0, t1, t2;
+	double ops;
+	Lanes lanes;
+	FILE *file;
+
+	chip8_iperiod = 15;
+	while ((opt = getopt(argc, argv, "l:n:i:q:r:s")) != -1)
+	{
+		switch (opt)
+		{
+		case 'l': count = atoi(optarg); break;
+		case 'n': frames = strtoul(optarg, NULL, 0); break;
+		case 'i': chip8_iperiod = atoi(optarg); break;
+		case 'q': chip8_quirks = strtoul(optarg, NULL, 0); break;
+		case 'r': seed = strtoul(optarg, NULL, 0); break;
+		case 's': shared = 1; break;
+		default:
+			fprintf(stderr, "usage: lanebench [-l lanes] [-n frames] [-i iperiod] [-q quirks] [-r seed] [-s] rom\n");
+			return 2;
+		}
+	}
+	if (count < 1 || count > LANES_MAX)
+	{
+		fprintf(stderr, "lanebench: 1 to %d lanes\n", LANES_MAX);
+		return 2;
+	}
+	if (optind >= argc || !(file = fopen(argv[optind], "rb")))
+	{
+		fprintf(stderr, "lanebench: cannot open ROM\n");
+		return 1;
+	}
+	srand(seed);
+	chip8_reset();
+	n = fread(chip8_mem + 0x200, 1, 4096 - 0x200, file);
+	fclose(file);
+	if (n <= 0) return 1;
+	chip8_save_state(&start);
+	scalar = malloc(count * sizeof(*scalar));
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (l = 0; l < count; l++)
+	{
+		chip8_load_state(&start);
+		chip8_rng = start.rng + l;
+		for (f = 0; f < frames; f++)
+		{
+			chip8_keys = laneKeys(seed, l, f);
+			chip8_frame();
+		}
+		chip8_save_state(&scalar[l]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	chip8_load_state(&start);
+	if (!lanesInit(&lanes, count))
+	{
+		fprintf(stderr, "lanebench: out of memory\n");
+		return 1;
+	}
+	for (l = 0; l < count; l++)
+		lanes.state[l].rng = start.rng + l;
+	for (f = 0; f < frames; f++)
+	{
+		for (l = 0; l < count; l++)
+			lanesSetKeys(&lanes, l, laneKeys(seed, l, f));
+		lanesFrame(&lanes);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+
+	for (l = 0; l < count; l++)
+	{
+		lanesGetState(&lanes, l, &lane);
+		if (memcmp(&lane.regs, &scalar[l].regs, sizeof(lane.regs)) || lane.rng != scalar[l].rng ||
+		    lane.key_pressed != scalar[l].key_pressed || memcmp(lane.mem, scalar[l].mem, sizeof(lane.mem)) ||
+		    memcmp(lane.display, scalar[l].display, sizeof(lane.display)))
+		{
+			printf("lane %d differs: pc %03x/%03x i %03x/%03x\n", l, lane.regs.pc, scalar[l].regs.pc, lane.regs.i, scalar[l].regs.i);
+			bad++;
+		}
+	}
+
+	ops = (double)count * frames * chip8_iperiod;
+	printf("%d lanes, %u frames: core %.1f Mops/s, lanes %.1f Mops/s (%.2fx)\n", count, frames,
+	       ops / seconds(&t0, &t1) / 1e6, ops / seconds(&t1, &t2) / 1e6, seconds(&t0, &t1) / seconds(&t1, &t2));
+	printf("vector %.1f%% of opcodes, %.2f lanes per vector step, %llu peels\n",
+	       100.0 * lanes.vectorOps / ops, lanes.steps ? (double)lanes.vectorOps / lanes.steps : 0.0,
+	       (unsigned long long)lanes.peels);
+	lanesFree(&lanes);
+	free(scalar);
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,305 @@
+/* Measure how long a key press takes to show on the display.
+ *
+ *   cc -O2 -Itools -I. -o latency tools/latency.c romdb.c CHIP8.c
+ *   latency [-n trials] [-w warmup] [-f frames] [-t hold] [-k keys] [-i iperiod]
+ *           [-q quirks] [-p present] [-r seed] [-d romdb] [-a ahead] [-W] rom...
+ *
+ * Each trial runs a ROM for a random number of warmup frames, then runs
+ * the same machine twice for at most -f frames, one opcode at a time: once
+ * untouched and once with a random key from the -k mask pressed at a
+ * random point of the first frame and held for -t frames. The first
+ * opcode after which the two displays differ is the response; it is seen
+ * at the end of the first frame whose display differs, plus -p frames for
+ * the presentation pipeline (1: the finished frame goes out at the next
+ * vblank).
+ *
+ * Latency is counted from the time of the press: in opcodes, in frames
+ * from the frame the press happened in to the one that shows it, and in
+ * milliseconds of a 50 Hz machine. With -W the press waits for the next
+ * timeslice as on the PSP, where a slice applies the input of the frame
+ * before it, the first change before its first opcode (see inputRunSlice).
+ * Trials where the display never changes are counted as no response.
+ *
+ * With -d each ROM runs with the iperiod and quirks of its database
+ * record, or the defaults, and presses only the keys its keymap uses
+ * unless -k is given.
+ *
+ * With -a each frame shows the display ahead frames later instead, run
+ * with the keys held at the end of the frame and then thrown away, as
+ * RUN_AHEAD does on the PSP. The time that takes is reported per frame.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "CHIP8.h"
+#include "romdb.h"
+
+#define FRAME_MS 20.0
+
+void chip8_sound_on (void) { }
+void chip8_sound_off (void) { }
+void chip8_interrupt (void) { }
+
+static unsigned long long hashDisplay(void)
+{
+	unsigned long long h = 0xcbf29ce484222325ULL;
+	size_t i;
+	for (i = 0; i < sizeof(chip8_display); i++)
+		h = (h ^ chip8_display[i]) * 0x100000001b3ULL;
+	return h;
+}
+
+static int ahead;
+static double aheadTime;
+static unsigned long aheadFrames;
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* step count opcodes, recording the display hash after each one and the
+   hash of the display shown at the end of each frame */
+static void record(unsigned long long *hash, unsigned long long *shown, int count, int key, int press, int release)
+{
+	static struct chip8_state state;
+	unsigned long long h = hashDisplay();
+	int n, i, reasons;
+	double t;
+	for (n = 0; n < count; n++)
+	{
+		if (key >= 0 && n == press) chip8_key(key, 1);
+		if (key >= 0 && n == release) chip8_key(key, 0);
+		reasons = chip8_run(1);
+		if (reasons & CHIP8_RUN_DISPLAY)
+			h = hashDisplay();
+		hash[n] = h;
+		if (!(reasons & CHIP8_RUN_FRAME))
+			continue;
+		shown[n / chip8_iperiod] = h;
+		if (!ahead)
+			continue;
+		t = now();
+		chip8_save_state(&state);
+		chip8_run_mask = 0;
+		for (i = 0; i < ahead && chip8_running == 1; i++)
+			chip8_frame();
+		aheadTime += now() - t;
+		aheadFrames++;
+		shown[n / chip8_iperiod] = hashDisplay();
+		t = now();
+		chip8_load_state(&state);
+		chip8_run_mask = CHIP8_RUN_DISPLAY;
+		aheadTime += now() - t;
+	}
+}
+
+typedef struct
+{
+	int frame;      // warmup frames before the press
+	int key;
+	int at;         // opcode of the frame the press happens before
+} Trial;
+
+static int compareTrials(const void *a, const void *b)
+{
+	return ((const Trial *)a)->frame - ((const Trial *)b)->frame;
+}
+
+static int compareInts(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+#define PERCENTILE(v, n, p) ((v)[((n) - 1) * (p) / 100])
+
+int main(int argc, char **argv)
+{
+	int trials = 200, warmup = 120, frames = 30, hold = 3, present = 1, window = 0;
+	int opt, n, t, rom, bad = 0;
+	unsigned keys = 0, seed = 1, romKeys;
+	unsigned long long *control = NULL, *test = NULL, *controlShown = NULL, *testShown = NULL;
+	int *ops, *frameLat, count, i;
+	const char *szDB = NULL;
+	RomSettings settings;
+	u8 image[4096 - 0x200];
+	double *ms;
+	Trial *trial;
+	struct chip8_state snapshot;
+	FILE *file;
+
+	chip8_iperiod = 15;
+	while ((opt = getopt(argc, argv, "n:w:f:t:k:i:q:p:r:d:a:W")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': trials = atoi(optarg); break;
+		case 'w': warmup = atoi(optarg); break;
+		case 'f': frames = atoi(optarg); break;
+		case 't': hold = atoi(optarg); break;
+		case 'k': keys = strtoul(optarg, NULL, 16) & 0xffff; break;
+		case 'i': chip8_iperiod = atoi(optarg); break;
+		case 'q': chip8_quirks = strtoul(optarg, NULL, 0); break;
+		case 'p': present = atoi(optarg); break;
+		case 'r': seed = strtoul(optarg, NULL, 0); break;
+		case 'd': szDB = optarg; break;
+		case 'a': ahead = atoi(optarg); break;
+		case 'W': window = 1; break;
+		default:
+			fprintf(stderr, "usage: latency [-n trials] [-w warmup] [-f frames] [-t hold] [-k keys] [-i iperiod]\n"
+			                "               [-q quirks] [-p present] [-r seed] [-d romdb] [-a ahead] [-W] rom...\n");
+			return 2;
+		}
+	}
+	if (optind >= argc || trials < 1 || warmup < 1 || frames < 2 || chip8_iperiod < 1)
+	{
+		fprintf(stderr, "latency: need a ROM, trials, warmup and frames\n");
+		return 2;
+	}
+	if (szDB && romdbOpen(szDB) < 0)
+	{
+		fprintf(stderr, "latency: cannot open %s\n", szDB);
+		return 1;
+	}
+
+	ops = malloc(trials * sizeof(*ops));
+	frameLat = malloc(trials * sizeof(*frameLat));
+	ms = malloc(trials * sizeof(*ms));
+	trial = malloc(trials * sizeof(*trial));
+
+	printf("%-10s %6s %5s  %-19s %-19s %s\n", "rom", "trials", "none",
+	       "opcodes p50/p90/max", "frames p50/p90/max", "ms min/p50/p90/max");
+	for (rom = optind; rom < argc; rom++)
+	{
+		const char *name = strrchr(argv[rom], '/') ? strrchr(argv[rom], '/') + 1 : argv[rom];
+		int responses = 0, none = 0, warm = 0, press;
+
+		if (!(file = fopen(argv[rom], "rb")))
+		{
+			fprintf(stderr, "latency: cannot open %s\n", argv[rom]);
+			bad++;
+			continue;
+		}
+		n = fread(image, 1, sizeof(image), file);
+		fclose(file);
+		if (n <= 0)
+		{
+			bad++;
+			continue;
+		}
+		romKeys = keys ? keys : 0xffff;
+		if (szDB)
+		{
+			const RomSettings *known = romdbFind(romdbHash(image, n));
+			if (known) settings = *known;
+			else romdbDefaults(&settings);
+			chip8_iperiod = settings.iperiod;
+			chip8_quirks = settings.quirks;
+			if (!keys)
+				for (romKeys = i = 0; i < ROMDB_BUTTONS; i++)
+					if (settings.keymap[i] < 16)
+						romKeys |= 1 << settings.keymap[i];
+		}
+		if (!romKeys || chip8_iperiod < 1)
+		{
+			fprintf(stderr, "latency: no keys or iperiod for %s\n", name);
+			bad++;
+			continue;
+		}
+		count = frames * chip8_iperiod;
+		control = realloc(control, count * sizeof(*control));
+		test = realloc(test, count * sizeof(*test));
+		controlShown = realloc(controlShown, frames * sizeof(*controlShown));
+		testShown = realloc(testShown, frames * sizeof(*testShown));
+
+		/* what an earlier, longer ROM left behind its end must not leak in */
+		srand(seed);
+		memset(chip8_mem, 0, sizeof(chip8_mem));
+		chip8_reset();
+		memcpy(chip8_mem + 0x200, image, n);
+
+		/* sorted by warmup so the machine only ever runs forward */
+		for (t = 0; t < trials; t++)
+		{
+			trial[t].frame = warmup / 2 + rand() % (warmup - warmup / 2 + 1);
+			do trial[t].key = rand() % 16; while (!(romKeys >> trial[t].key & 1));
+			trial[t].at = rand() % chip8_iperiod;
+		}
+		qsort(trial, trials, sizeof(*trial), compareTrials);
+
+		for (t = 0; t < trials; t++)
+		{
+			chip8_run_mask = 0;
+			for (; warm < trial[t].frame && chip8_running == 1; warm++)
+				chip8_frame();
+			if (chip8_running != 1)
+			{
+				none++;
+				continue;
+			}
+			chip8_save_state(&snapshot);
+			press = window ? chip8_iperiod : trial[t].at;
+
+			chip8_run_mask = CHIP8_RUN_DISPLAY;
+			record(control, controlShown, count, -1, 0, 0);
+			chip8_load_state(&snapshot);
+			record(test, testShown, count, trial[t].key, press, press + hold * chip8_iperiod);
+			chip8_load_state(&snapshot);
+
+			for (n = press; n < count && test[n] == control[n]; n++)
+				;
+			for (i = 0; i < frames && testShown[i] == controlShown[i]; i++)
+				;
+			if (n == count || i == frames)
+			{
+				none++;
+				continue;
+			}
+			/* the display first differs after opcode n and is first shown
+			   differently at the end of frame i, then present frames later;
+			   the press came at/iperiod into frame 0 */
+			ops[responses] = n + 1 - trial[t].at;
+			frameLat[responses] = i + present;
+			ms[responses] = (frameLat[responses] + 1 - (double)trial[t].at / chip8_iperiod) * FRAME_MS;
+			responses++;
+		}
+
+		if (!responses)
+		{
+			printf("%-10s %6d %5d  no response\n", name, trials, none);
+			continue;
+		}
+		qsort(ops, responses, sizeof(*ops), compareInts);
+		qsort(frameLat, responses, sizeof(*frameLat), compareInts);
+		qsort(ms, responses, sizeof(*ms), compareDoubles);
+		printf("%-10s %6d %5d  %5d %5d %5d   %5d %5d %5d   %5.1f %5.1f %5.1f %5.1f\n", name, trials, none,
+		       PERCENTILE(ops, responses, 50), PERCENTILE(ops, responses, 90), ops[responses - 1],
+		       PERCENTILE(frameLat, responses, 50), PERCENTILE(frameLat, responses, 90), frameLat[responses - 1],
+		       ms[0], PERCENTILE(ms, responses, 50), PERCENTILE(ms, responses, 90), ms[responses - 1]);
+	}
+
+	if (ahead)
+		printf("run-ahead %d: %.1f us per frame, %.2f%% of a frame\n", ahead,
+		       aheadTime / aheadFrames * 1e6, aheadTime / aheadFrames * 1e5 / FRAME_MS);
+	free(control);
+	free(test);
+	free(controlShown);
+	free(testShown);
+	free(ops);
+	free(frameLat);
+	free(ms);
+	free(trial);
+	if (szDB) romdbClose();
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+/* One side of a netplay session, driven by random input, for checking
+ * that two peers stay in step over a bad link.
+ *
+ *   cc -O2 -Itools -I. -o netpeer tools/netpeer.c netplay.c timer.c CHIP8.c
+ *   netpeer -p 6502 -P 6503 [-h host] [-n frames] [-l latency_ms] [-d loss%] [-s seed] rom &
+ *   netpeer -p 6503 -P 6502 -k 1 [-h host] [-n frames] [-l latency_ms] [-d loss%] [-s seed] rom
+ *
+ * -k picks which key bits this side presses. Once both peers have run the
+ * requested frames each prints a hash of the machine state; the two
+ * hashes must match.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "CHIP8.h"
+#include "netplay.h"
+#include "timer.h"
+
+void chip8_sound_on (void) { }
+void chip8_sound_off (void) { }
+void chip8_interrupt (void) { }
+
+static u64 hashState(void)
+{
+	struct chip8_state s;
+	const u8 *p = (const u8*)&s;
+	u64 h = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	memset(&s, 0, sizeof(s));
+	chip8_save_state(&s);
+	for (i = 0; i < sizeof(s); i++)
+		h = (h ^ p[i]) * 0x100000001b3ULL;
+	return h;
+}
+
+int main(int argc, char **argv)
+{
+	const char *szHost = "127.0.0.1";
+	int localPort = NETPLAY_PORT, peerPort = NETPLAY_PORT + 1;
+	int latency = 0, loss = 0, side = 0, opt, n;
+	unsigned frames = 2000, seed = 1, idle = 0;
+	u16 keys = 0;
+	FILE *file;
+
+	while ((opt = getopt(argc, argv, "p:P:h:n:l:d:s:k:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'p': localPort = atoi(optarg); break;
+		case 'P': peerPort = atoi(optarg); break;
+		case 'h': szHost = optarg; break;
+		case 'n': frames = strtoul(optarg, NULL, 0); break;
+		case 'l': latency = atoi(optarg); break;
+		case 'd': loss = atoi(optarg); break;
+		case 's': seed = strtoul(optarg, NULL, 0); break;
+		case 'k': side = atoi(optarg) & 1; break;
+		default:
+			fprintf(stderr, "usage: netpeer [-p port] [-P peer port] [-h host] [-n frames] [-l latency_ms] [-d loss%%] [-s seed] [-k side] rom\n");
+			return 2;
+		}
+	}
+	if (optind >= argc || !(file = fopen(argv[optind], "rb")))
+	{
+		fprintf(stderr, "netpeer: cannot open ROM\n");
+		return 1;
+	}
+	chip8_iperiod = 15;
+	chip8_reset();
+	n = fread(chip8_mem + 0x200, 1, 4096 - 0x200, file);
+	fclose(file);
+	if (n <= 0) return 1;
+
+	if (!netplayOpen(localPort, szHost, peerPort, seed))
+	{
+		perror("netpeer");
+		return 1;
+	}
+	netplaySetConditions(latency, loss);
+	srand(getpid());
+
+	while (netplayStats()->frame < frames)
+	{
+		/* side 0 holds the even keys, side 1 the odd ones */
+		if (rand() % 8 == 0)
+			keys ^= 1 << ((rand() % 8) * 2 + side);
+		netplayFrame(keys);
+		timerSleep(2000000);
+	}
+	/* settle: the state is final once both sides have all inputs, and we
+	   linger so the peer hears that we have theirs */
+	while (netplayStats()->confirmed < frames || netplayStats()->acked < frames || idle++ < 200)
+	{
+		netplayPoll();
+		timerSleep(5000000);
+	}
+
+	const NetplayStats *s = netplayStats();
+	printf("%u frames, %u rollbacks (%u frames resimulated, longest %u), %u stalls\n",
+	       s->frame, s->rollbacks, s->resimulated, s->maxRollback, s->stalls);
+	printf("sent %u received %u dropped %u\n", s->sent, s->received, s->dropped);
+	printf("state %016llx\n", (unsigned long long)hashState());
+	netplayClose();
+	return 0;
+}
@@ -0,0 +1,221 @@
+/* Check phosphor persistence against a plain loop and stored goldens.
+ *
+ *   cc -O2 -Itools -I. -o phosphortest tools/phosphortest.c phosphor.c
+ *   phosphortest [-u] [-n frames] [-g golden]
+ *
+ * A fixed 64x32 flicker sequence is blended at several decays: a block
+ * lit every frame, one lit on every other frame, one lit only in the
+ * first frame and a patch of noise. Every frame must match a scalar
+ * version of the blend, the steady block must stay at 0xff and the block
+ * lit once must be back to 0 within 256 frames. The intensity buffers at
+ * a few frames are compared with tools/phosphor.golden, or written there
+ * with -u. Finally blendPhosphor is timed over -n frames at both display
+ * sizes against the scalar version.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "phosphor.h"
+
+#define WIDTH 64
+#define HEIGHT 32
+#define FRAMES 300
+
+static const int decays[] = { 64, 192, 240, 255 };
+static const int checkpoints[] = { 1, 2, 7, 30 };
+#define DECAYS (int)(sizeof(decays) / sizeof(decays[0]))
+#define CHECKPOINTS (int)(sizeof(checkpoints) / sizeof(checkpoints[0]))
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int inBlock(int x, int y, int bx)
+{
+	return x >= bx && x < bx + 8 && y >= 4 && y < 12;
+}
+
+/* frame f of the sequence */
+static void makeFrame(u8 *display, int f)
+{
+	unsigned rng = 12345 + f * 2654435761u;
+	int x, y;
+
+	for (y = 0; y < HEIGHT; y++)
+		for (x = 0; x < WIDTH; x++)
+		{
+			int lit = inBlock(x, y, 4) ||               // steady
+			          (inBlock(x, y, 20) && !(f & 1)) || // flickering
+			          (inBlock(x, y, 36) && f == 0);     // lit once
+			if (y >= 16)
+			{
+				rng = rng * 1103515245u + 12345u;
+				lit = (rng >> 16) % 5 == 0;
+			}
+			display[y * WIDTH + x] = lit ? 0xff : 0;
+		}
+}
+
+static void blendScalar(u8 *intensity, const u8 *display, int count, int decay)
+{
+	int i;
+	for (i = 0; i < count; i++)
+	{
+		unsigned v = (intensity[i] * decay) >> 8;
+		intensity[i] = display[i] > v ? display[i] : v;
+	}
+}
+
+static void writeBuffer(FILE *file, int decay, int frame, const u8 *buffer)
+{
+	int x, y;
+	fprintf(file, "decay %d frame %d\n", decay, frame);
+	for (y = 0; y < HEIGHT; y++)
+	{
+		for (x = 0; x < WIDTH; x++)
+			fprintf(file, "%02x", buffer[y * WIDTH + x]);
+		fprintf(file, "\n");
+	}
+}
+
+/* @return 1 if the next buffer in the golden file is this one */
+static int readBuffer(FILE *file, int decay, int frame, const u8 *buffer)
+{
+	int d, f, x, y;
+	unsigned v;
+	if (fscanf(file, " decay %d frame %d", &d, &f) != 2 || d != decay || f != frame)
+		return 0;
+	for (y = 0; y < HEIGHT; y++)
+		for (x = 0; x < WIDTH; x++)
+			if (fscanf(file, "%2x", &v) != 1 || v != buffer[y * WIDTH + x])
+				return 0;
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *szGolden = "tools/phosphor.golden";
+	int update = 0, frames = 20000, opt, d, f, c, x, y, bad = 0;
+	u8 display[WIDTH * HEIGHT], want[WIDTH * HEIGHT];
+	static u8 big[PHOSPHOR_MAX_PIXELS], bigWant[PHOSPHOR_MAX_PIXELS];
+	const u8 *got;
+	double t, simdTime, scalarTime;
+	FILE *file;
+
+	while ((opt = getopt(argc, argv, "un:g:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'u': update = 1; break;
+		case 'n': frames = atoi(optarg); break;
+		case 'g': szGolden = optarg; break;
+		default:
+			fprintf(stderr, "usage: phosphortest [-u] [-n frames] [-g golden]\n");
+			return 2;
+		}
+	}
+	if (!(file = fopen(szGolden, update ? "w" : "r")))
+	{
+		perror(szGolden);
+		return 1;
+	}
+
+	for (d = 0; d < DECAYS; d++)
+	{
+		setPhosphorDecay(0);
+		setPhosphorDecay(decays[d]);
+		memset(want, 0, sizeof(want));
+		for (f = 0, c = 0; f < FRAMES; f++)
+		{
+			makeFrame(display, f);
+			got = blendPhosphor(display, WIDTH * HEIGHT);
+			blendScalar(want, display, WIDTH * HEIGHT, decays[d]);
+			if (memcmp(got, want, sizeof(want)))
+			{
+				printf("decay %d frame %d: differs from the scalar blend\n", decays[d], f);
+				bad++;
+				break;
+			}
+			for (y = 4; y < 12; y++)
+				for (x = 0; x < 8; x++)
+				{
+					if (got[y * WIDTH + 4 + x] != 0xff)
+					{
+						printf("decay %d frame %d: steady pixel at %02x\n", decays[d], f, got[y * WIDTH + 4 + x]);
+						bad++;
+						f = FRAMES;
+					}
+					if (f >= 256 && f < FRAMES && got[y * WIDTH + 36 + x])
+					{
+						printf("decay %d frame %d: pixel lit once still at %02x\n", decays[d], f, got[y * WIDTH + 36 + x]);
+						bad++;
+						f = FRAMES;
+					}
+				}
+			if (c < CHECKPOINTS && f == checkpoints[c])
+			{
+				if (update)
+					writeBuffer(file, decays[d], f, got);
+				else if (!readBuffer(file, decays[d], f, got))
+				{
+					printf("decay %d frame %d: differs from %s\n", decays[d], f, szGolden);
+					bad++;
+				}
+				c++;
+			}
+		}
+	}
+	fclose(file);
+
+	/* a count that is no multiple of 16 runs the tail through the scalar loop */
+	setPhosphorDecay(0);
+	setPhosphorDecay(200);
+	memset(bigWant, 0, sizeof(bigWant));
+	for (f = 0; f < 64; f++)
+	{
+		for (x = 0; x < PHOSPHOR_MAX_PIXELS; x++)
+			big[x] = (x * 7 + f * 13) % 11 < 3 ? 0xff : 0;
+		got = blendPhosphor(big, PHOSPHOR_MAX_PIXELS - 5);
+		blendScalar(bigWant, big, PHOSPHOR_MAX_PIXELS - 5, 200);
+		if (memcmp(got, bigWant, PHOSPHOR_MAX_PIXELS - 5))
+		{
+			printf("odd count, frame %d: differs from the scalar blend\n", f);
+			bad++;
+			break;
+		}
+	}
+
+	if (frames > 0)
+	{
+		int count;
+		for (count = 64 * 32; count <= 128 * 64; count *= 4)
+		{
+			setPhosphorDecay(0);
+			setPhosphorDecay(200);
+			t = now();
+			for (f = 0; f < frames; f++)
+			{
+				big[f % count] ^= 0xff;
+				blendPhosphor(big, count);
+			}
+			simdTime = (now() - t) / frames;
+			t = now();
+			for (f = 0; f < frames; f++)
+			{
+				big[f % count] ^= 0xff;
+				blendScalar(bigWant, big, count, 200);
+			}
+			scalarTime = (now() - t) / frames;
+			printf("%d pixels: blendPhosphor %.0f ns/frame, scalar %.0f ns/frame\n", count, simdTime * 1e9, scalarTime * 1e9);
+		}
+	}
+
+	printf("%s\n", update ? "goldens written" : bad ? "FAILED" : "ok");
+	return bad ? 1 : 0;
+}
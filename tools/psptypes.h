@@ -0,0 +1,20 @@
+/* Stand-in for the PSPSDK <psptypes.h> so the portable modules can be
+   built into host tools; put this directory on the include path. */
+#ifndef PSPTYPES_H
+#define PSPTYPES_H
+
+#include <stdint.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+typedef unsigned int SceSize;
+typedef int SceUID;
+
+#endif
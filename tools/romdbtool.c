@@ -0,0 +1,252 @@
+/* Build romdb.bin from a settings list and a ROM collection.
+ *
+ *   cc -O2 -pthread -Itools -I. -o romdbtool tools/romdbtool.c romdb.c
+ *   romdbtool [-j jobs] [-a] [-o romdb.bin] romdb.txt romdir...
+ *
+ * romdb.txt has one line per ROM file name:
+ *
+ *   NAME  iperiod  quirks  machine  keymap
+ *
+ * quirks is a number made of CHIP8_QUIRK_* flags, machine is chip8 or
+ * schip, keymap gives the CHIP8 key (hex digit, or - for none) for
+ * up, down, left, right, cross, circle, square, triangle, L and R.
+ * Every file under the ROM directories is hashed, in parallel, and gets
+ * the settings listed for its name; -a also adds unlisted ROMs with the
+ * default settings.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "romdb.h"
+
+typedef struct
+{
+	char name[64];
+	RomSettings settings;
+	int used;
+} Listed;
+
+typedef struct
+{
+	char *path;
+	const char *name;
+	u64 hash;
+	int ok;
+} Rom;
+
+static Listed *listed;
+static int numListed;
+static Rom *roms;
+static int numRoms, capRoms;
+static int nextRom;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int parseKeymap(const char *s, u8 *keymap)
+{
+	int i;
+	if (strlen(s) != ROMDB_BUTTONS) return 0;
+	for (i = 0; i < ROMDB_BUTTONS; i++)
+	{
+		if (s[i] == '-') keymap[i] = ROMDB_UNMAPPED;
+		else if (isxdigit((unsigned char)s[i])) keymap[i] = (u8) strtol((char[]){s[i], 0}, NULL, 16);
+		else return 0;
+	}
+	return 1;
+}
+
+static int readList(const char *szPath)
+{
+	char line[256], name[64], machine[16], keys[32];
+	int iperiod, quirks, n = 0, cap = 0;
+	FILE *f = fopen(szPath, "r");
+
+	if (!f) return 0;
+	while (fgets(line, sizeof(line), f))
+	{
+		n++;
+		if (line[0] == '#' || line[strspn(line, " \t\r\n")] == 0) continue;
+		if (sscanf(line, "%63s %d %i %15s %31s", name, &iperiod, &quirks, machine, keys) != 5 ||
+		    iperiod < 1 || iperiod > 255)
+		{
+			fprintf(stderr, "%s:%d: bad line\n", szPath, n);
+			continue;
+		}
+		if (numListed == cap)
+		{
+			cap = cap ? cap * 2 : 64;
+			listed = realloc(listed, cap * sizeof(Listed));
+		}
+		Listed *l = &listed[numListed];
+		romdbDefaults(&l->settings);
+		strcpy(l->name, name);
+		l->settings.iperiod = iperiod;
+		l->settings.quirks = quirks;
+		l->settings.machine = strcasecmp(machine, "schip") ? ROMDB_CHIP8 : ROMDB_SCHIP;
+		l->used = 0;
+		if (!parseKeymap(keys, l->settings.keymap))
+		{
+			fprintf(stderr, "%s:%d: bad keymap '%s'\n", szPath, n, keys);
+			continue;
+		}
+		numListed++;
+	}
+	fclose(f);
+	return 1;
+}
+
+static void addRoms(const char *szDir)
+{
+	struct dirent *d;
+	struct stat st;
+	DIR *dir = opendir(szDir);
+
+	if (!dir)
+	{
+		perror(szDir);
+		return;
+	}
+	while ((d = readdir(dir)))
+	{
+		char *path;
+		if (d->d_name[0] == '.') continue;
+		path = malloc(strlen(szDir) + strlen(d->d_name) + 2);
+		sprintf(path, "%s/%s", szDir, d->d_name);
+		if (stat(path, &st) < 0) { free(path); continue; }
+		if (S_ISDIR(st.st_mode))
+		{
+			addRoms(path);
+			free(path);
+			continue;
+		}
+		if (numRoms == capRoms)
+		{
+			capRoms = capRoms ? capRoms * 2 : 256;
+			roms = realloc(roms, capRoms * sizeof(Rom));
+		}
+		roms[numRoms].path = path;
+		roms[numRoms].name = strrchr(path, '/') + 1;
+		roms[numRoms].ok = 0;
+		numRoms++;
+	}
+	closedir(dir);
+}
+
+static void *hashWorker(void *arg)
+{
+	u8 buf[4096];
+	(void)arg;
+	for (;;)
+	{
+		int i;
+		size_t n;
+		FILE *f;
+
+		pthread_mutex_lock(&lock);
+		i = nextRom++;
+		pthread_mutex_unlock(&lock);
+		if (i >= numRoms) return NULL;
+
+		/* only the part that fits in CHIP8 memory is ever loaded */
+		if (!(f = fopen(roms[i].path, "rb"))) continue;
+		n = fread(buf, 1, 4096 - 0x200, f);
+		fclose(f);
+		if (!n) continue;
+		roms[i].hash = romdbHash(buf, n);
+		roms[i].ok = 1;
+	}
+}
+
+/* by hash, so copies of an image end up next to each other */
+static int compareRoms(const void *a, const void *b)
+{
+	const Rom *x = (const Rom*)a, *y = (const Rom*)b;
+	if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+	return strcmp(x->path, y->path);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: romdbtool [-j jobs] [-a] [-o romdb.bin] romdb.txt romdir...\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *out = "romdb.bin";
+	int jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	int all = 0, opt, i, j, count = 0;
+	pthread_t *threads;
+	RomSettings *records;
+
+	while ((opt = getopt(argc, argv, "j:ao:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'j': jobs = atoi(optarg); break;
+		case 'a': all = 1; break;
+		case 'o': out = optarg; break;
+		default: usage();
+		}
+	}
+	if (argc - optind < 2) usage();
+	if (jobs < 1) jobs = 1;
+
+	if (!readList(argv[optind]))
+	{
+		perror(argv[optind]);
+		return 1;
+	}
+	for (i = optind + 1; i < argc; i++)
+		addRoms(argv[i]);
+
+	threads = malloc(jobs * sizeof(pthread_t));
+	for (i = 0; i < jobs; i++)
+		pthread_create(&threads[i], NULL, hashWorker, NULL);
+	for (i = 0; i < jobs; i++)
+		pthread_join(threads[i], NULL);
+
+	qsort(roms, numRoms, sizeof(Rom), compareRoms);
+	records = malloc((numRoms + 1) * sizeof(RomSettings));
+	for (i = 0; i < numRoms; i++)
+	{
+		const RomSettings *s = NULL;
+		RomSettings def;
+		if (!roms[i].ok) continue;
+		for (j = 0; j < numListed; j++)
+			if (!strcasecmp(listed[j].name, roms[i].name))
+			{
+				s = &listed[j].settings;
+				listed[j].used = 1;
+				break;
+			}
+		if (!s && all)
+		{
+			romdbDefaults(&def);
+			s = &def;
+		}
+		if (!s) continue;
+		/* the same image under two names only needs one record */
+		if (count && records[count - 1].hash == roms[i].hash) continue;
+		records[count] = *s;
+		records[count].hash = roms[i].hash;
+		count++;
+	}
+	for (j = 0; j < numListed; j++)
+		if (!listed[j].used)
+			fprintf(stderr, "warning: %s is listed but was not found\n", listed[j].name);
+
+	if (!romdbWrite(out, records, count))
+	{
+		perror(out);
+		return 1;
+	}
+	printf("%s: %d of %d ROMs indexed\n", out, count, numRoms);
+	return 0;
+}
@@ -0,0 +1,124 @@
+/* Time the display scaler against the per-pixel blit it replaced.
+ *
+ *   cc -O2 -Itools -I. -o scalerbench tools/scalerbench.c scaler.c
+ *   scalerbench [-n frames] [-r seed]
+ *
+ * For every scale from 1 to SCALER_MAX_SCALE, random displays at the
+ * plain and SCHIP sizes are drawn both ways and must match byte for
+ * byte; the times are per frame. The narrow widths are there for the
+ * portable 8-pixel path, which hosts with SSE2 only take for the last
+ * 8 pixels of a row that is not a multiple of 16 wide.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "scaler.h"
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* update_display before the scaler, with the pitch of the surface */
+static void blitPixels(const u8 *src, int width, int height, int scale, Color *dst, int pitch, Color on, Color off)
+{
+	int x, y, mx, my;
+	for (y = 0; y < height; y++, src += width)
+		for (my = 0; my < scale; my++)
+		{
+			Color *out = dst + (y * scale + my) * pitch;
+			for (x = 0; x < width; x++)
+				for (mx = 0; mx < scale; mx++)
+					*out++ = src[x] == 0xff ? on : off;
+		}
+}
+
+static const struct { int width, height; } sizes[] = { { 64, 32 }, { 128, 64 }, { 8, 4 }, { 24, 8 }, { 72, 16 } };
+#define SIZES (int)(sizeof(sizes) / sizeof(sizes[0]))
+#define DISPLAYS 16
+
+int main(int argc, char **argv)
+{
+	static const Color colors[][2] = { { 0xffffff, 0x000000 }, { 0x40ff80, 0x102010 } };
+	int frames = 2000, opt, s, scale, c, d, f, i, bad = 0;
+	unsigned seed = 1;
+	u8 *displays;
+	Color *want, *got;
+	double t, oldTime, newTime;
+
+	while ((opt = getopt(argc, argv, "n:r:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': frames = atoi(optarg); break;
+		case 'r': seed = strtoul(optarg, NULL, 0); break;
+		default:
+			fprintf(stderr, "usage: scalerbench [-n frames] [-r seed]\n");
+			return 2;
+		}
+	}
+	if (frames < 1)
+	{
+		fprintf(stderr, "scalerbench: need frames\n");
+		return 2;
+	}
+
+	srand(seed);
+	displays = malloc(DISPLAYS * 128 * 64);
+	want = malloc((128 * SCALER_MAX_SCALE + 16) * 64 * SCALER_MAX_SCALE * sizeof(Color));
+	got = malloc((128 * SCALER_MAX_SCALE + 16) * 64 * SCALER_MAX_SCALE * sizeof(Color));
+	/* blank, full, then random with more and more pixels lit */
+	for (d = 0; d < DISPLAYS; d++)
+		for (i = 0; i < 128 * 64; i++)
+			displays[d * 128 * 64 + i] = d == 0 ? 0 : d == 1 ? 0xff : rand() % (DISPLAYS - 1) < d - 1 ? 0xff : 0;
+
+	printf("%-8s %5s  %12s %12s %7s\n", "size", "scale", "old ns/frame", "lut ns/frame", "speedup");
+	for (s = 0; s < SIZES; s++)
+		for (scale = 1; scale <= SCALER_MAX_SCALE; scale++)
+		{
+			int width = sizes[s].width, height = sizes[s].height;
+			int pitch = width * scale + 16;     // as a texture, wider than the image
+			size_t bytes = (size_t)pitch * height * scale * sizeof(Color);
+
+			for (c = 0; c < 2; c++)
+			{
+				setScalerColors(colors[c][0], colors[c][1]);
+				for (d = 0; d < DISPLAYS; d++)
+				{
+					memset(want, 0x55, bytes);
+					memset(got, 0x55, bytes);
+					blitPixels(displays + d * 128 * 64, width, height, scale, want, pitch, colors[c][0], colors[c][1]);
+					scaleDisplay(displays + d * 128 * 64, width, height, scale, got, pitch);
+					if (memcmp(want, got, bytes))
+					{
+						printf("%dx%d at %dx, display %d, colours %d: output differs\n", width, height, scale, d, c);
+						bad++;
+					}
+				}
+			}
+			if (width < 64)
+				continue;
+
+			setScalerColors(0xffffff, 0x000000);
+			t = now();
+			for (f = 0; f < frames; f++)
+				blitPixels(displays + f % DISPLAYS * 128 * 64, width, height, scale, want, pitch, 0xffffff, 0x000000);
+			oldTime = (now() - t) / frames;
+			t = now();
+			for (f = 0; f < frames; f++)
+				scaleDisplay(displays + f % DISPLAYS * 128 * 64, width, height, scale, got, pitch);
+			newTime = (now() - t) / frames;
+			printf("%3dx%-4d %5d  %12.0f %12.0f %6.1fx\n", width, height, scale, oldTime * 1e9, newTime * 1e9, oldTime / newTime);
+		}
+
+	printf("%s\n", bad ? "FAILED" : "outputs match");
+	free(displays);
+	free(want);
+	free(got);
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,193 @@
+/* Draw a known screen through the offscreen graphics backend and compare
+ * it with a stored golden image, then time the drawing.
+ *
+ *   cc -O2 -Itools -I. -o screentest tools/screentest.c tools/msxfont.c graphics.c graphics_mem.c scaler.c
+ *   screentest [-u] [-n frames] [-g golden.ppm] [-o out.ppm]
+ *
+ * The screen is drawn like the emulator and the file browser draw theirs:
+ * cleared to black, a fixed 64x32 display scaled 4x and blitted to the
+ * middle, the same image once more clipped at the top right corner, a
+ * title and every printable character in two text colours, one line long
+ * enough to wrap. The flipped frame is written with dumpOffscreenFrame and
+ * compared with tools/screen.golden.ppm, or written there with -u. Then
+ * each step is timed over -n frames (0 to skip). The text uses the
+ * stand-in font of tools/msxfont.c, not the PSP one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "graphics.h"
+#include "scaler.h"
+
+#define WIDTH 64
+#define HEIGHT 32
+#define MAG 4
+#define LINE_CHARS 48
+
+static u8 display[WIDTH * HEIGHT];
+static Image *image;
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* a border, a diagonal and a checkered block */
+static void makeDisplay(void)
+{
+	int x, y;
+	for (y = 0; y < HEIGHT; y++)
+		for (x = 0; x < WIDTH; x++)
+		{
+			int lit = x == 0 || y == 0 || x == WIDTH - 1 || y == HEIGHT - 1 || x == y * 2 ||
+			          (x >= 40 && x < 56 && y >= 8 && y < 24 && ((x ^ y) & 1));
+			display[y * WIDTH + x] = lit ? 0xff : 0;
+		}
+}
+
+static void drawDisplay(void)
+{
+	scaleDisplay(display, WIDTH, HEIGHT, MAG, image->data, image->textureWidth);
+	blitImageToScreen(0, 0, image->imageWidth, image->imageHeight, image,
+	                  SCREEN_WIDTH / 2 - WIDTH * MAG / 2, SCREEN_HEIGHT / 2 - HEIGHT * MAG / 2);
+	blitImageToScreen(0, 0, image->imageWidth, image->imageHeight, image, SCREEN_WIDTH - 80, -40);
+}
+
+static void drawText(void)
+{
+	char line[LINE_CHARS + 1];
+	int c, i, y = SCREEN_HEIGHT / 2 + HEIGHT * MAG / 2 + 8;
+
+	printText(0, 0, "ms0:/PSP/GAME/CHIP8/ROMS  [*.ch8]", RGB(255,255,255));
+	for (c = 32; c < 127; y += 8)
+	{
+		for (i = 0; i < LINE_CHARS && c < 127; i++, c++)
+			line[i] = c;
+		line[i] = 0;
+		printText(4, y, line, y == SCREEN_HEIGHT / 2 + HEIGHT * MAG / 2 + 8 ? RGB(255,255,255) : RGB(200,200,200));
+	}
+	printText(4, y, "a line of the browser that is too long for the screen and goes on below", RGB(200,200,200));
+}
+
+static void drawScreen(void)
+{
+	clearScreen(0);
+	drawDisplay();
+	drawText();
+	flipScreen();
+}
+
+/* @return the number of pixels that differ, or -1 if a file cannot be read */
+static long comparePPM(const char *szA, const char *szB, int *firstX, int *firstY)
+{
+	static u8 a[SCREEN_WIDTH * SCREEN_HEIGHT * 3 + 64], b[sizeof(a)];
+	size_t na, nb, i, header;
+	long diff = 0;
+	FILE *file;
+
+	if (!(file = fopen(szA, "rb"))) return -1;
+	na = fread(a, 1, sizeof(a), file);
+	fclose(file);
+	if (!(file = fopen(szB, "rb"))) return -1;
+	nb = fread(b, 1, sizeof(b), file);
+	fclose(file);
+	if (na != nb || na < SCREEN_WIDTH * SCREEN_HEIGHT * 3) return -1;
+
+	header = na - SCREEN_WIDTH * SCREEN_HEIGHT * 3;
+	if (memcmp(a, b, header)) return -1;
+	for (i = header; i < na; i += 3)
+		if (memcmp(a + i, b + i, 3) && !diff++)
+		{
+			*firstX = (i - header) / 3 % SCREEN_WIDTH;
+			*firstY = (i - header) / 3 / SCREEN_WIDTH;
+		}
+	return diff;
+}
+
+typedef void (*Step)(void);
+
+static double timeStep(Step step, int frames)
+{
+	double t = now();
+	int f;
+	for (f = 0; f < frames; f++)
+		step();
+	return (now() - t) / frames;
+}
+
+static void stepClear(void) { clearScreen(0); }
+static void stepFlip(void) { flipScreen(); }
+
+int main(int argc, char **argv)
+{
+	const char *szGolden = "tools/screen.golden.ppm", *szOut = "screentest.ppm";
+	int update = 0, frames = 2000, opt, x = 0, y = 0, bad = 0;
+	long diff;
+
+	while ((opt = getopt(argc, argv, "un:g:o:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'u': update = 1; break;
+		case 'n': frames = atoi(optarg); break;
+		case 'g': szGolden = optarg; break;
+		case 'o': szOut = optarg; break;
+		default:
+			fprintf(stderr, "usage: screentest [-u] [-n frames] [-g golden.ppm] [-o out.ppm]\n");
+			return 2;
+		}
+	}
+
+	if (!initOffscreenGraphics() || !(image = createImage(WIDTH * MAG, HEIGHT * MAG)))
+	{
+		fprintf(stderr, "screentest: out of memory\n");
+		return 1;
+	}
+	setScalerColors(0xffffff, 0x000000);
+	makeDisplay();
+	drawScreen();
+
+	if (!dumpOffscreenFrame(update ? szGolden : szOut))
+	{
+		perror(update ? szGolden : szOut);
+		return 1;
+	}
+	if (!update)
+	{
+		diff = comparePPM(szGolden, szOut, &x, &y);
+		if (diff < 0)
+		{
+			printf("%s and %s cannot be compared\n", szGolden, szOut);
+			bad++;
+		}
+		else if (diff)
+		{
+			printf("%ld pixels differ from %s, the first at %d,%d\n", diff, szGolden, x, y);
+			bad++;
+		}
+	}
+
+	if (frames > 0)
+	{
+		static const char *names[] = { "clear", "display", "text", "flip", "whole screen" };
+		static const Step steps[] = { stepClear, drawDisplay, drawText, stepFlip, drawScreen };
+		double t;
+		int s;
+		for (s = 0; s < 5; s++)
+			printf("%-12s %8.1f us per frame\n", names[s], timeStep(steps[s], frames) * 1e6);
+		t = now();
+		for (s = 0; s < frames / 100 + 1; s++)
+			dumpOffscreenFrame(szOut);
+		printf("%-12s %8.1f us per frame\n", "dump", (now() - t) / (frames / 100 + 1) * 1e6);
+	}
+
+	freeImage(image);
+	freeOffscreenGraphics();
+	printf("%s\n", update ? "golden written" : bad ? "FAILED" : "ok");
+	return bad ? 1 : 0;
+}
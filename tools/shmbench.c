@@ -0,0 +1,192 @@
+/* Publish frames through shmexport.c and read them from another process.
+ *
+ *   cc -O2 -Itools -I. -o shmbench tools/shmbench.c shmexport.c CHIP8.c -lrt
+ *   shmbench [-n frames] [-i iperiod] [-r seed] [-f fps] [-d delay] [-x name] [-b] rom
+ *
+ * A child process runs the ROM with random key presses, as fast as it can
+ * or at -f frames per second, and publishes every frame. The parent follows the ring, reading the
+ * newest frame in place each time, and checks it against its own run of
+ * the same machine. -d makes the reader sleep that many microseconds
+ * after every frame to show that a slow reader only misses frames and
+ * never slows the writer. With -b the child first runs once without
+ * exporting, for a baseline.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "CHIP8.h"
+#include "shmexport.h"
+
+void chip8_sound_on (void) { }
+void chip8_sound_off (void) { }
+void chip8_interrupt (void) { }
+
+static unsigned seed = 1;
+static u8 rom[4096 - 0x200];
+static int romSize, iperiod = 15, fps;
+
+static u16 keysAt(u32 frame)
+{
+	unsigned x = seed * 0x9e3779b9u ^ (frame / 8) * 0x85ebca6bu;
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	return x & 16 ? 1 << (x >> 8 & 15) : 0;
+}
+
+static void startMachine(void)
+{
+	chip8_iperiod = iperiod;
+	chip8_run_mask = 0;
+	chip8_reset();
+	memcpy(chip8_mem + 0x200, rom, romSize);
+	chip8_rng = seed;
+}
+
+static void runFrame(u32 frame)
+{
+	chip8_keys = keysAt(frame);
+	chip8_frame();
+}
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int writer(const char *szName, u32 frames, int baseline)
+{
+	static const ShmWindow window = { 0x200, 0x100 };
+	double start, ahead;
+	u32 f;
+
+	if (baseline)
+	{
+		startMachine();
+		start = now();
+		for (f = 0; f < frames && chip8_running == 1; f++)
+			runFrame(f);
+		printf("writer: %.0f frames/s without exporting\n", f / (now() - start));
+	}
+	if (!shmExportOpen(szName, &window, 1))
+	{
+		fprintf(stderr, "shmbench: cannot export to %s\n", szName);
+		return 1;
+	}
+	/* let the reader map the ring before the first frame */
+	usleep(100000);
+	startMachine();
+	start = now();
+	for (f = 0; f < frames && chip8_running == 1; f++)
+	{
+		runFrame(f);
+		shmExportFrame();
+		if (fps && (ahead = start + (double)(f + 1) / fps - now()) > 0)
+			usleep(ahead * 1e6);
+	}
+	printf("writer: %.0f frames/s exporting\n", f / (now() - start));
+	fflush(stdout);
+	shmExportClose();
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *szName = "/chip8bench";
+	u32 frames = 200000, head, last = 0, ours = 0, seq;
+	u32 read = 0, torn = 0, wrong = 0;
+	int opt, delay = 0, baseline = 0, status, tries, differs;
+	const ShmExportSlot *slot;
+	ShmReader reader;
+	pid_t child;
+	FILE *file;
+
+	while ((opt = getopt(argc, argv, "n:i:r:f:d:x:b")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': frames = strtoul(optarg, NULL, 0); break;
+		case 'i': iperiod = atoi(optarg); break;
+		case 'r': seed = strtoul(optarg, NULL, 0); break;
+		case 'f': fps = atoi(optarg); break;
+		case 'd': delay = atoi(optarg); break;
+		case 'x': szName = optarg; break;
+		case 'b': baseline = 1; break;
+		default:
+			fprintf(stderr, "usage: shmbench [-n frames] [-i iperiod] [-r seed] [-f fps] [-d delay] [-x name] [-b] rom\n");
+			return 2;
+		}
+	}
+	if (optind >= argc || !frames || iperiod < 1 || !(file = fopen(argv[optind], "rb")))
+	{
+		fprintf(stderr, "shmbench: cannot open ROM\n");
+		return 2;
+	}
+	romSize = fread(rom, 1, sizeof(rom), file);
+	fclose(file);
+	if (romSize <= 0) return 1;
+
+	shm_unlink(szName);
+	fflush(stdout);
+	if ((child = fork()) < 0)
+	{
+		perror("shmbench");
+		return 1;
+	}
+	if (!child)
+		return writer(szName, frames, baseline);
+
+	for (tries = 0; !shmReaderOpen(&reader, szName); tries++)
+	{
+		if (tries == 5000 || waitpid(child, &status, WNOHANG) == child)
+		{
+			fprintf(stderr, "shmbench: no ring at %s\n", szName);
+			return 1;
+		}
+		usleep(1000);
+	}
+
+	startMachine();
+	while (!shmReaderClosed(&reader))
+	{
+		head = shmReaderHead(&reader);
+		if (head == last)
+		{
+			sched_yield();
+			continue;
+		}
+		last = head;
+		if (!(slot = shmReaderBegin(&reader, head - 1, &seq)))
+			continue;
+		/* catch up in our own machine, then compare in place */
+		while (ours < head)
+			runFrame(ours++);
+		differs = memcmp(slot->display, chip8_display, sizeof(chip8_display)) ||
+		      memcmp(slot->v, chip8_regs.alg, 16) || slot->pc != chip8_regs.pc ||
+		      memcmp(slot->mem, chip8_mem + 0x200, 0x100);
+		if (!shmReaderEnd(&reader, slot, seq))
+			torn++;
+		else
+		{
+			read++;
+			wrong += differs;
+		}
+		if (delay)
+			usleep(delay);
+	}
+	head = shmReaderHead(&reader);
+	shmReaderClose(&reader);
+	waitpid(child, &status, 0);
+
+	printf("reader: %u of %u frames read, %u overwritten while reading, %u wrong\n",
+	       read, head, torn, wrong);
+	return wrong || !WIFEXITED(status) || WEXITSTATUS(status);
+}
@@ -0,0 +1,181 @@
+/* Time rasterText against the text loops it replaced, on a memory
+ * framebuffer.
+ *
+ *   cc -O2 -Itools -I. -o textbench tools/textbench.c graphics.c
+ *   textbench [-n screens] [-r seed]
+ *
+ * Each screen is drawn like the file browser: cleared to black, a title
+ * and 30 lines of 40 to 59 characters, alternating between two colours.
+ * It is drawn three ways: with the old per-pixel loop of printText, with
+ * the masked read-modify-write of the first glyph atlas, and with
+ * rasterText. All three must leave the same pixels. The font is made up
+ * here, a quarter of its rows blank like the real one; msx comes with the
+ * PSP build.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "graphics.h"
+
+#define LINES 30
+
+u8 msx[256 * 8];
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* printText as it was: strlen every character, a branch every pixel */
+static void oldText(Color *surface, int pitch, int x, int y, const char *text, u32 color)
+{
+	int c, i, j, ox = x;
+	u8 *font;
+	Color *vram_ptr;
+	Color *vram;
+
+	for (c = 0; c < (int)strlen(text); c++) {
+		if (x < 0 || y < 0 || y + 8 > SCREEN_HEIGHT) break;
+		char ch = text[c];
+		if (x > SCREEN_WIDTH) {
+			x = ox;
+			y += 8;
+		}
+		vram = surface + x + y * pitch;
+		if (ch == '\n') {
+			x = ox;
+			y += 8;
+			if (y > SCREEN_HEIGHT)
+				return;
+			continue;
+		}
+		font = &msx[(u8)ch * 8];
+		for (i = 0; i < 8; i++, font++) {
+			vram_ptr = vram;
+			for (j = 0; j < 8; j++) {
+				if ((*font & (128 >> j))) *vram_ptr = color;
+				vram_ptr++;
+			}
+			vram += pitch;
+		}
+		x += 8;
+	}
+}
+
+/* the first atlas: pixel masks per row byte, stores merged with the screen */
+static Color rowMasks[256][8];
+
+static void maskedText(Color *surface, int pitch, int x, int y, const char *text, u32 color)
+{
+	int i, j;
+	const unsigned char *c;
+
+	for (c = (const unsigned char*)text; *c; c++) {
+		if (x < 0 || y < 0 || y + 8 > SCREEN_HEIGHT || x + 8 > SCREEN_WIDTH) break;
+		Color *vram = surface + x + y * pitch;
+		const u8 *rows = &msx[*c * 8];
+		for (i = 0; i < 8; i++, vram += pitch) {
+			const Color *m = rowMasks[rows[i]];
+			if (!rows[i]) continue;
+			for (j = 0; j < 8; j++)
+				vram[j] = (vram[j] & ~m[j]) | (color & m[j]);
+		}
+		x += 8;
+	}
+}
+
+typedef void (*TextFunc)(Color *surface, int pitch, int x, int y, const char *text, u32 color);
+
+static char lines[LINES][64];
+
+static void drawScreen(TextFunc draw, Color *surface)
+{
+	int i;
+	memset(surface, 0, PSP_LINE_SIZE * SCREEN_HEIGHT * sizeof(Color));
+	draw(surface, PSP_LINE_SIZE, 0, 0, "ms0:/PSP/GAME/CHIP8/ROMS  [*.ch8]", RGB(255,255,255));
+	for (i = 0; i < LINES; i++)
+		draw(surface, PSP_LINE_SIZE, 4, i * 8 + 16, lines[i], i == 5 ? RGB(255,255,255) : RGB(200,200,200));
+}
+
+static double timeScreens(TextFunc draw, Color *surface, int screens)
+{
+	double t = now();
+	int s;
+	for (s = 0; s < screens; s++)
+		drawScreen(draw, surface);
+	return (now() - t) / screens;
+}
+
+int main(int argc, char **argv)
+{
+	static const char *names[] = { "per-pixel", "masked", "rasterText" };
+	static const TextFunc funcs[] = { oldText, maskedText, rasterText };
+	int screens = 2000, opt, i, j, f, bad = 0;
+	unsigned seed = 1;
+	Color *surfaces[3];
+	double times[3];
+
+	while ((opt = getopt(argc, argv, "n:r:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n': screens = atoi(optarg); break;
+		case 'r': seed = strtoul(optarg, NULL, 0); break;
+		default:
+			fprintf(stderr, "usage: textbench [-n screens] [-r seed]\n");
+			return 2;
+		}
+	}
+	if (screens < 1)
+	{
+		fprintf(stderr, "textbench: need screens\n");
+		return 2;
+	}
+
+	srand(seed);
+	for (i = 0; i < 256 * 8; i++)
+		msx[i] = i < 32 * 8 || rand() % 4 == 0 ? 0 : rand() & 0xff;
+	for (i = 0; i < 256; i++)
+		for (j = 0; j < 8; j++)
+			rowMasks[i][j] = (i & (128 >> j)) ? 0xffffffff : 0;
+	for (i = 0; i < LINES; i++)
+	{
+		int length = 40 + rand() % 20;
+		for (j = 0; j < length; j++)
+			lines[i][j] = 32 + rand() % 95;
+		lines[i][j] = 0;
+	}
+
+	for (f = 0; f < 3; f++)
+	{
+		surfaces[f] = malloc(PSP_LINE_SIZE * SCREEN_HEIGHT * sizeof(Color));
+		drawScreen(funcs[f], surfaces[f]);
+		if (f && memcmp(surfaces[0], surfaces[f], PSP_LINE_SIZE * SCREEN_HEIGHT * sizeof(Color)))
+		{
+			printf("%s draws different pixels from the per-pixel loop\n", names[f]);
+			bad++;
+		}
+	}
+	for (f = 0; f < 3; f++)
+		times[f] = timeScreens(funcs[f], surfaces[f], screens);
+	/* without the clear, which all three pay the same */
+	{
+		double clear = now();
+		for (i = 0; i < screens; i++)
+			memset(surfaces[0], 0, PSP_LINE_SIZE * SCREEN_HEIGHT * sizeof(Color));
+		clear = (now() - clear) / screens;
+		for (f = 0; f < 3; f++)
+			printf("%-10s %8.1f us per screen of text, %5.2fx the per-pixel loop\n", names[f],
+			       (times[f] - clear) * 1e6, (times[0] - clear) / (times[f] - clear));
+	}
+
+	printf("%s\n", bad ? "FAILED" : "output matches");
+	for (f = 0; f < 3; f++)
+		free(surfaces[f]);
+	return bad ? 1 : 0;
+}